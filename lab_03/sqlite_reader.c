@@ -2,6 +2,16 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 
 uint64_t decode_varint(const unsigned char *p, int *len_out){
@@ -44,298 +54,3250 @@ int64_t read_be_signed(const unsigned char *p, int n)
     return (v << shift) >> shift;
 }
 
-void print_record(const unsigned char *record, int rlen)
+/* Body size in bytes of a column with serial type st. */
+uint64_t serial_size(uint64_t st)
+{
+    static const unsigned char fixed[12] = { 0, 1, 2, 3, 4, 6, 8, 8, 0, 0, 0, 0 };
+
+    if (st < 12)
+        return fixed[st];
+
+    return (st - 12) / 2;
+}
+
+double read_be_double(const unsigned char *p)
+{
+    uint64_t bits = 0;
+    double d;
+
+    for (int i = 0; i < 8; ++i)
+        bits = (bits << 8) | p[i];
+
+    memcpy(&d, &bits, 8);
+    return d;
+}
+
+/*
+ * Walks a record in place: the header varints and the body are read straight
+ * from wherever the record lives (page buffer or overflow scratch), nothing is
+ * copied out.
+ */
+struct record_cursor
+{
+    const unsigned char *rec;
+    uint64_t size;
+    uint64_t hdr_end;
+    uint64_t hdrpos;
+    uint64_t bodypos;
+};
+
+struct column_value
+{
+    uint64_t serial;
+    const unsigned char *data;
+    uint64_t len;
+};
+
+int record_open(struct record_cursor *c, const unsigned char *rec, uint64_t size)
 {
     int hlensz;
-    uint64_t header_sz = decode_varint(record, &hlensz);
-    int hdrpos = hlensz;
 
-    while (hdrpos < (int) header_sz)
-    {
-        int stlen;
-        decode_varint(record + hdrpos, &stlen);
-        hdrpos += stlen;
+    if (size == 0)
+        return -1;
+
+    c->rec = rec;
+    c->size = size;
+    c->hdr_end = decode_varint(rec, &hlensz);
+    c->hdrpos = hlensz;
+    c->bodypos = c->hdr_end;
+
+    return c->hdr_end > size || c->hdr_end < (uint64_t)hlensz ? -1 : 0;
+}
+
+/* Returns 1 and fills v for the next column, 0 past the last column, -1 on a corrupt record. */
+int record_next(struct record_cursor *c, struct column_value *v)
+{
+    int stlen;
+
+    if (c->hdrpos >= c->hdr_end)
+        return 0;
+
+    v->serial = decode_varint(c->rec + c->hdrpos, &stlen);
+    v->len = serial_size(v->serial);
+    c->hdrpos += stlen;
+
+    if (c->hdrpos > c->hdr_end || v->len > c->size - c->bodypos)
+        return -1;
+
+    v->data = c->rec + c->bodypos;
+    c->bodypos += v->len;
+
+    return 1;
+}
+
+int64_t column_int(const struct column_value *v)
+{
+    if (v->serial == 8)
+        return 0;
+    if (v->serial == 9)
+        return 1;
+
+    return read_be_signed(v->data, (int)v->len);
+}
+
+/*
+ * Growable output buffer. Rows are formatted into it and handed to the sink
+ * (stdout) in large writes; without a sink the bytes stay in the buffer for
+ * the caller to collect.
+ */
+#define OUT_FLUSH_BYTES (64 * 1024)
+
+struct outbuf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    FILE *sink;
+    int failed;
+};
+
+int out_reserve(struct outbuf *ob, size_t n)
+{
+    if (ob->len + n <= ob->cap)
+        return 0;
+
+    size_t cap = ob->cap ? ob->cap : 4096;
+
+    while (cap < ob->len + n)
+        cap *= 2;
+
+    char *data = realloc(ob->data, cap);
+
+    if (!data)
+    {
+        if (!ob->failed)
+            fprintf(stderr, "oom\n");
+        ob->failed = 1;
+        return -1;
+    }
+
+    ob->data = data;
+    ob->cap = cap;
+    return 0;
+}
+
+void out_write(struct outbuf *ob, const void *p, size_t n)
+{
+    if (out_reserve(ob, n) == 0)
+    {
+        memcpy(ob->data + ob->len, p, n);
+        ob->len += n;
+    }
+}
+
+void out_str(struct outbuf *ob, const char *s)
+{
+    out_write(ob, s, strlen(s));
+}
+
+void out_char(struct outbuf *ob, char c)
+{
+    if (ob->len < ob->cap || out_reserve(ob, 1) == 0)
+        ob->data[ob->len++] = c;
+}
+
+void out_uint(struct outbuf *ob, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+
+    do
+    {
+        tmp[sizeof(tmp) - ++n] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    out_write(ob, tmp + sizeof(tmp) - n, n);
+}
+
+void out_int(struct outbuf *ob, int64_t v)
+{
+    if (v < 0)
+    {
+        out_char(ob, '-');
+        out_uint(ob, 0 - (uint64_t)v);
+    }
+    else
+        out_uint(ob, v);
+}
+
+/*
+ * Shortest fixed-point decimal that reads back as exactly x, using at most
+ * max_digits significant digits; falls back to snprintf with fallback_fmt
+ * outside [1e-4, 10^max_digits) or when no such decimal exists (digits are
+ * also capped at 2^53). With
+ * max_digits 6 and "%g" the output is what printf("%g") gives; with 17 and
+ * "%.17g" it always round-trips. m / 10^k is exact when both fit in 53
+ * bits, and correctly rounded like strtod, so a match proves the round trip.
+ */
+void out_double(struct outbuf *ob, double x, int max_digits, const char *fallback_fmt)
+{
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    double ax = x < 0 ? -x : x;
+    double limit = max_digits < 16 ? pow10[max_digits] : 9007199254740992.0;
+
+    if (x == 0)
+    {
+        out_str(ob, signbit(x) ? "-0" : "0");
+        return;
+    }
+
+    if (ax >= 1e-4 && ax < limit)
+    {
+        for (int k = 0; k <= 22; ++k)
+        {
+            double scaled = ax * pow10[k];
+
+            if (scaled >= limit)
+                break;
+
+            uint64_t m = (uint64_t)(scaled + 0.5);
+
+            if ((double)m / pow10[k] != ax)
+                continue;
+
+            char tmp[48];
+            int n = 0;
+
+            for (int i = 0; i < k || m; ++i)
+            {
+                tmp[sizeof(tmp) - ++n] = '0' + m % 10;
+                m /= 10;
+                if (i == k - 1)
+                    tmp[sizeof(tmp) - ++n] = '.';
+            }
+
+            if (tmp[sizeof(tmp) - n] == '.')
+                tmp[sizeof(tmp) - ++n] = '0';
+            if (x < 0)
+                tmp[sizeof(tmp) - ++n] = '-';
+
+            out_write(ob, tmp + sizeof(tmp) - n, n);
+            return;
+        }
+    }
+
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), fallback_fmt, x);
+
+    out_write(ob, tmp, n);
+}
+
+void out_flush(struct outbuf *ob)
+{
+    if (ob->sink && ob->len)
+    {
+        if (fwrite(ob->data, 1, ob->len, ob->sink) != ob->len)
+            ob->failed = 1;
+        ob->len = 0;
+    }
+}
+
+/* Called once per row; returns non-zero once output has failed. */
+int out_row_done(struct outbuf *ob)
+{
+    if (ob->len >= OUT_FLUSH_BYTES)
+        out_flush(ob);
+
+    return ob->failed;
+}
+
+void print_value(struct outbuf *ob, const struct column_value *v)
+{
+    uint64_t st = v->serial;
+
+    if (st == 0)
+        out_str(ob, "NULL");
+    else if (st >= 1 && st <= 6)
+        out_int(ob, column_int(v));
+    else if (st == 7)
+        out_double(ob, read_be_double(v->data), 6, "%g");
+    else if (st >= 13 && (st % 2))
+    {
+        out_char(ob, '\'');
+        out_write(ob, v->data, v->len);
+        out_char(ob, '\'');
+    }
+    else if (st >= 12)
+    {
+        out_str(ob, "BLOB(");
+        out_uint(ob, v->len);
+        out_char(ob, ')');
+    }
+    else if (st == 8)
+        out_char(ob, '0');
+    else if (st == 9)
+        out_char(ob, '1');
+}
+
+void print_record(struct outbuf *ob, const unsigned char *record, int rlen)
+{
+    struct record_cursor c;
+    struct column_value v;
+    int rc, first = 1;
+
+    if (record_open(&c, record, rlen) != 0)
+    {
+        out_str(ob, "<corrupt record>\n");
+        return;
+    }
+
+    while ((rc = record_next(&c, &v)) > 0)
+    {
+        if (!v.serial)
+            continue;
+
+        if (!first)
+            out_str(ob, " | ");
+        first = 0;
+
+        print_value(ob, &v);
+    }
+
+    if (rc < 0)
+        out_str(ob, "<corrupt record>");
+
+    out_char(ob, '\n');
+}
+
+#define MAX_BTREE_DEPTH 64
+
+/*
+ * Page cache over the database file. Pages live in a fixed pool of frames
+ * and are read with pread on a miss; a CLOCK hand picks the victim among
+ * unpinned frames. Callers pin a page with pager_get and must release it
+ * with pager_unpin before the frame can be reused. With use_mmap the file
+ * is mapped instead and the pool is not used.
+ */
+struct frame
+{
+    uint64_t pgno;
+    int pins;
+    int ref;
+    int next;
+};
+
+/*
+ * Compressed container written by sqlite_writer -z: a 24-byte header
+ * ("SQLZPG01", then big-endian u32 page size, page count, pages per group
+ * and codec) followed by ngroups + 1 big-endian u64 file offsets. Group g
+ * is [off[g], off[g + 1]) and holds its pages deflated with zlib, or raw
+ * when compressing did not make it smaller.
+ */
+#define ZPAGE_MAGIC "SQLZPG01"
+#define ZPAGE_HEADER 24
+#define ZPAGE_CODEC_ZLIB 1
+
+struct pager
+{
+    int fd;
+    int page_size;
+    uint64_t page_count;
+    uint32_t group_pages;
+    uint64_t *group_offsets;
+    unsigned char *zbuf;
+    size_t zcap;
+    unsigned char *group_buf;
+    uint64_t cur_group;
+    unsigned char *map;
+    size_t map_len;
+    int nframes;
+    struct frame *frames;
+    unsigned char *pool;
+    int *buckets;
+    int nbuckets;
+    int hand;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+void pager_close(struct pager *pg)
+{
+    if (pg->map)
+        munmap(pg->map, pg->map_len);
+
+    free(pg->frames);
+    free(pg->pool);
+    free(pg->buckets);
+    free(pg->group_offsets);
+    free(pg->group_buf);
+    free(pg->zbuf);
+    close(pg->fd);
+}
+
+uint64_t read_be64(const unsigned char *p)
+{
+    uint64_t v = 0;
+
+    for (int i = 0; i < 8; ++i)
+        v = (v << 8) | p[i];
+
+    return v;
+}
+
+int pread_full(int fd, void *buf, size_t n, off_t off)
+{
+    size_t done = 0;
+
+    while (done < n)
+    {
+        ssize_t r = pread(fd, (unsigned char *)buf + done, n - done, off + done);
+
+        if (r <= 0)
+        {
+            if (r < 0)
+                perror("pread");
+            return -1;
+        }
+
+        done += r;
+    }
+
+    return 0;
+}
+
+/* Reads the container header and offset table; the file stays raw otherwise. */
+int pager_open_container(struct pager *pg, const unsigned char *hdr, off_t file_size)
+{
+    uint32_t codec = ((uint32_t)hdr[20] << 24) | (hdr[21] << 16) | (hdr[22] << 8) | hdr[23];
+    uint64_t ngroups;
+    unsigned char *table;
+
+    pg->page_size = ((uint32_t)hdr[8] << 24) | (hdr[9] << 16) | (hdr[10] << 8) | hdr[11];
+    pg->page_count = ((uint32_t)hdr[12] << 24) | (hdr[13] << 16) | (hdr[14] << 8) | hdr[15];
+    pg->group_pages = ((uint32_t)hdr[16] << 24) | (hdr[17] << 16) | (hdr[18] << 8) | hdr[19];
+
+    if (pg->page_size < 512 || pg->page_size > 65536 || (pg->page_size & (pg->page_size - 1)))
+    {
+        fprintf(stderr, "bad page size %d\n", pg->page_size);
+        return -1;
+    }
+
+    if (codec != ZPAGE_CODEC_ZLIB || pg->group_pages == 0 || (uint64_t)pg->group_pages * pg->page_size > (64 << 20))
+    {
+        fprintf(stderr, "unsupported compressed page container\n");
+        return -1;
+    }
+
+    ngroups = (pg->page_count + pg->group_pages - 1) / pg->group_pages;
+    table = malloc((ngroups + 1) * 8);
+    pg->group_offsets = malloc((ngroups + 1) * sizeof(uint64_t));
+    pg->group_buf = malloc((size_t)pg->group_pages * pg->page_size);
+
+    if (!table || !pg->group_offsets || !pg->group_buf)
+    {
+        fprintf(stderr, "oom\n");
+        free(table);
+        return -1;
+    }
+
+    if (pread_full(pg->fd, table, (ngroups + 1) * 8, ZPAGE_HEADER) != 0)
+    {
+        fprintf(stderr, "truncated page offset table\n");
+        free(table);
+        return -1;
+    }
+
+    for (uint64_t g = 0; g <= ngroups; ++g)
+    {
+        pg->group_offsets[g] = read_be64(table + g * 8);
+
+        if (pg->group_offsets[g] > (uint64_t)file_size || (g && pg->group_offsets[g] < pg->group_offsets[g - 1]))
+        {
+            fprintf(stderr, "corrupt page offset table\n");
+            free(table);
+            return -1;
+        }
+    }
+
+    free(table);
+    pg->cur_group = UINT64_MAX;
+    return 0;
+}
+
+/*
+ * Opens a database file, plain or in the compressed container, and sizes
+ * the frame pool from cache_bytes. The page size comes from the file.
+ */
+int pager_open(struct pager *pg, const char *fname, size_t cache_bytes, int use_mmap)
+{
+    struct stat st;
+    unsigned char hdr[100];
+
+    memset(pg, 0, sizeof(*pg));
+    pg->fd = open(fname, O_RDONLY);
+    if (pg->fd < 0)
+    {
+        perror("open");
+        return -1;
+    }
+
+    if (fstat(pg->fd, &st) != 0)
+    {
+        perror("stat");
+        close(pg->fd);
+        return -1;
+    }
+
+    if (pread_full(pg->fd, hdr, sizeof(hdr), 0) != 0)
+    {
+        fprintf(stderr, "file too small\n");
+        close(pg->fd);
+        return -1;
+    }
+
+    if (memcmp(hdr, ZPAGE_MAGIC, 8) == 0)
+    {
+        if (pager_open_container(pg, hdr, st.st_size) != 0)
+        {
+            pager_close(pg);
+            return -1;
+        }
+
+        use_mmap = 0;
+    }
+    else if (memcmp(hdr, "SQLite format 3\0", 16) == 0)
+    {
+        pg->page_size = (hdr[16] << 8) | hdr[17];
+        if (pg->page_size == 1)
+            pg->page_size = 65536;
+
+        if (pg->page_size < 512 || (pg->page_size & (pg->page_size - 1)))
+        {
+            fprintf(stderr, "bad page size %d\n", pg->page_size);
+            close(pg->fd);
+            return -1;
+        }
+
+        pg->page_count = st.st_size / pg->page_size;
+    }
+    else
+    {
+        fprintf(stderr, "not sqlite db\n");
+        close(pg->fd);
+        return -1;
+    }
+
+    const int page_size = pg->page_size;
+
+    if (use_mmap)
+    {
+        pg->map_len = st.st_size;
+        pg->map = mmap(NULL, pg->map_len, PROT_READ, MAP_SHARED, pg->fd, 0);
+        if (pg->map == MAP_FAILED)
+        {
+            perror("mmap");
+            close(pg->fd);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    pg->nframes = cache_bytes / page_size;
+    if (pg->nframes < 8)
+        pg->nframes = 8;
+
+    pg->nbuckets = 1;
+    while (pg->nbuckets < pg->nframes * 2)
+        pg->nbuckets <<= 1;
+
+    pg->frames = calloc(pg->nframes, sizeof(struct frame));
+    pg->pool = malloc((size_t)pg->nframes * page_size);
+    pg->buckets = malloc(pg->nbuckets * sizeof(int));
+
+    if (!pg->frames || !pg->pool || !pg->buckets)
+    {
+        fprintf(stderr, "oom\n");
+        pager_close(pg);
+        return -1;
+    }
+
+    for (int i = 0; i < pg->nbuckets; ++i)
+        pg->buckets[i] = -1;
+
+    return 0;
+}
+
+
+int pager_bucket(const struct pager *pg, uint64_t pgno)
+{
+    return (int)((pgno * 0x9E3779B97F4A7C15ULL) >> 32) & (pg->nbuckets - 1);
+}
+
+void pager_unlink(struct pager *pg, int fi)
+{
+    int *link = &pg->buckets[pager_bucket(pg, pg->frames[fi].pgno)];
+
+    while (*link != fi)
+        link = &pg->frames[*link].next;
+
+    *link = pg->frames[fi].next;
+}
+
+/*
+ * Inflates group g of a compressed container into group_buf. The last group
+ * decoded is kept, so a scan pays for each group once.
+ */
+int pager_load_group(struct pager *pg, uint64_t g)
+{
+    uint64_t first = g * pg->group_pages;
+    uint64_t npages = pg->page_count - first < pg->group_pages ? pg->page_count - first : pg->group_pages;
+    uLongf raw = npages * pg->page_size;
+    uint64_t zlen = pg->group_offsets[g + 1] - pg->group_offsets[g];
+
+    if (pg->cur_group == g)
+        return 0;
+
+    pg->cur_group = UINT64_MAX;
+
+    if (zlen == raw)
+        return pread_full(pg->fd, pg->group_buf, raw, pg->group_offsets[g]) == 0 ? (pg->cur_group = g, 0) : -1;
+
+    if (zlen > pg->zcap)
+    {
+        unsigned char *nb = realloc(pg->zbuf, zlen);
+
+        if (!nb)
+        {
+            fprintf(stderr, "oom\n");
+            return -1;
+        }
+
+        pg->zbuf = nb;
+        pg->zcap = zlen;
+    }
+
+    if (pread_full(pg->fd, pg->zbuf, zlen, pg->group_offsets[g]) != 0)
+        return -1;
+
+    if (uncompress(pg->group_buf, &raw, pg->zbuf, zlen) != Z_OK || raw != npages * pg->page_size)
+    {
+        fprintf(stderr, "corrupt compressed page group %llu\n", (unsigned long long)g);
+        return -1;
+    }
+
+    pg->cur_group = g;
+    return 0;
+}
+
+int pager_read(struct pager *pg, uint64_t pgno, unsigned char *data)
+{
+    if (!pg->group_offsets)
+        return pread_full(pg->fd, data, pg->page_size, (off_t)(pgno - 1) * pg->page_size);
+
+    uint64_t g = (pgno - 1) / pg->group_pages;
+
+    if (pager_load_group(pg, g) != 0)
+        return -1;
+
+    memcpy(data, pg->group_buf + (pgno - 1 - g * pg->group_pages) * pg->page_size, pg->page_size);
+    return 0;
+}
+
+/* Advance the CLOCK hand to an unpinned frame whose reference bit is clear. */
+int pager_victim(struct pager *pg)
+{
+    for (int swept = 0; swept < 2 * pg->nframes; ++swept)
+    {
+        int fi = pg->hand;
+        struct frame *fr = &pg->frames[fi];
+
+        pg->hand = (pg->hand + 1) % pg->nframes;
+
+        if (fr->pins)
+            continue;
+
+        if (fr->ref)
+        {
+            fr->ref = 0;
+            continue;
+        }
+
+        return fi;
+    }
+
+    return -1;
+}
+
+unsigned char *pager_get(struct pager *pg, uint64_t pgno)
+{
+    if (pgno == 0 || pgno > pg->page_count)
+        return NULL;
+
+    if (pg->map)
+        return pg->map + (pgno - 1) * pg->page_size;
+
+    int b = pager_bucket(pg, pgno);
+
+    for (int fi = pg->buckets[b]; fi >= 0; fi = pg->frames[fi].next)
+    {
+        if (pg->frames[fi].pgno == pgno)
+        {
+            pg->frames[fi].pins++;
+            pg->frames[fi].ref = 1;
+            pg->hits++;
+            return pg->pool + (size_t)fi * pg->page_size;
+        }
+    }
+
+    int fi = pager_victim(pg);
+    if (fi < 0)
+    {
+        fprintf(stderr, "page cache exhausted: all %d frames pinned\n", pg->nframes);
+        return NULL;
+    }
+
+    struct frame *fr = &pg->frames[fi];
+    unsigned char *data = pg->pool + (size_t)fi * pg->page_size;
+
+    if (fr->pgno)
+        pager_unlink(pg, fi);
+    fr->pgno = 0;
+
+    if (pager_read(pg, pgno, data) != 0)
+        return NULL;
+
+    fr->pgno = pgno;
+    fr->pins = 1;
+    fr->ref = 1;
+    fr->next = pg->buckets[b];
+    pg->buckets[b] = fi;
+    pg->misses++;
+
+    return data;
+}
+
+void pager_unpin(struct pager *pg, const unsigned char *page)
+{
+    if (pg->map || !page)
+        return;
+
+    pg->frames[(page - pg->pool) / pg->page_size].pins--;
+}
+
+/* Ask the kernel to start reading a page we are about to visit. */
+void pager_prefetch(struct pager *pg, uint64_t pgno)
+{
+    if (pgno == 0 || pgno > pg->page_count)
+        return;
+
+    if (pg->group_offsets)
+    {
+        uint64_t g = (pgno - 1) / pg->group_pages;
+
+        posix_fadvise(pg->fd, pg->group_offsets[g], pg->group_offsets[g + 1] - pg->group_offsets[g], POSIX_FADV_WILLNEED);
+    }
+    else if (pg->map)
+        madvise(pg->map + ((pgno - 1) * pg->page_size & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1)), pg->page_size, MADV_WILLNEED);
+    else
+        posix_fadvise(pg->fd, (off_t)(pgno - 1) * pg->page_size, pg->page_size, POSIX_FADV_WILLNEED);
+}
+
+struct db
+{
+    struct pager *pager;
+    int page_size;
+    int usable_size;
+};
+
+struct table_cell
+{
+    uint64_t rowid;
+    uint64_t payload_size;
+    unsigned char *payload;
+    uint64_t local_size;
+    uint32_t overflow;
+};
+
+/* Reusable buffer for payloads that spill onto overflow pages. */
+struct scratch
+{
+    unsigned char *buf;
+    uint64_t cap;
+};
+
+typedef int (*table_cell_fn)(struct db *db, const struct table_cell *cell, void *arg);
+
+unsigned char *get_page(struct db *db, uint64_t pgno)
+{
+    return pager_get(db->pager, pgno);
+}
+
+void put_page(struct db *db, const unsigned char *page)
+{
+    pager_unpin(db->pager, page);
+}
+
+void prefetch_page(struct db *db, uint64_t pgno)
+{
+    pager_prefetch(db->pager, pgno);
+}
+
+uint32_t read_be32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int read_be16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/* Bytes of a cell payload stored on the b-tree page itself (file format 1.6). */
+uint64_t local_payload_size(int usable_size, uint64_t payload_size, int index)
+{
+    uint64_t x = index ? ((uint64_t)(usable_size - 12) * 64 / 255) - 23 : (uint64_t)(usable_size - 35);
+    uint64_t m = ((uint64_t)(usable_size - 12) * 32 / 255) - 23;
+    uint64_t k;
+
+    if (payload_size <= x)
+        return payload_size;
+
+    k = m + (payload_size - m) % (usable_size - 4);
+
+    return k <= x ? k : m;
+}
+
+/*
+ * Makes the whole payload of a cell addressable. On-page payloads are returned
+ * in place; spilled ones are stitched together from the overflow chain into
+ * the scratch buffer, which is grown but never shrunk.
+ */
+const unsigned char *load_payload(struct db *db, const struct table_cell *cell, struct scratch *scratch)
+{
+    uint64_t have = cell->local_size;
+    uint32_t next = cell->overflow;
+
+    if (!next)
+        return cell->payload;
+
+    if (scratch->cap < cell->payload_size)
+    {
+        unsigned char *nb = realloc(scratch->buf, cell->payload_size);
+
+        if (!nb)
+        {
+            fprintf(stderr, "oom\n");
+            return NULL;
+        }
+
+        scratch->buf = nb;
+        scratch->cap = cell->payload_size;
+    }
+
+    memcpy(scratch->buf, cell->payload, have);
+
+    while (have < cell->payload_size)
+    {
+        unsigned char *ovfl = get_page(db, next);
+        uint64_t chunk = db->usable_size - 4;
+
+        if (!ovfl)
+        {
+            fprintf(stderr, "overflow page %u out of range\n", next);
+            return NULL;
+        }
+
+        if (chunk > cell->payload_size - have)
+            chunk = cell->payload_size - have;
+
+        memcpy(scratch->buf + have, ovfl + 4, chunk);
+        have += chunk;
+        next = read_be32(ovfl);
+        put_page(db, ovfl);
+    }
+
+    return scratch->buf;
+}
+
+/* Child page of interior cell i, or the right-most pointer when i == cell count. */
+uint32_t interior_child(const unsigned char *hdr, const unsigned char *page, int i)
+{
+    int cellcnt = read_be16(hdr + 3);
+
+    if (i == cellcnt)
+        return read_be32(hdr + 8);
+
+    return read_be32(page + read_be16(hdr + 12 + i * 2));
+}
+
+/* Decodes cell ci of a table leaf. Returns 0 on success, 1 for a cell pointer to skip, -1 if corrupt. */
+int parse_leaf_cell(struct db *db, unsigned char *page, const unsigned char *hdr, uint64_t pgno, int ci, struct table_cell *cell)
+{
+    int cellptr = read_be16(hdr + 8 + ci * 2);
+    int l1, l2;
+
+    if (cellptr <= 0 || cellptr >= db->page_size)
+        return 1;
+
+    unsigned char *p = page + cellptr;
+
+    cell->payload_size = decode_varint(p, &l1);
+    cell->rowid = decode_varint(p + l1, &l2);
+    cell->payload = p + l1 + l2;
+    cell->local_size = local_payload_size(db->usable_size, cell->payload_size, 0);
+    cell->overflow = 0;
+
+    if (cellptr + l1 + l2 + cell->local_size + (cell->local_size < cell->payload_size ? 4 : 0) > (uint64_t)db->page_size)
+    {
+        fprintf(stderr, "cell %d on page %llu overruns the page\n", ci, (unsigned long long)pgno);
+        return -1;
+    }
+
+    if (cell->local_size < cell->payload_size)
+        cell->overflow = read_be32(cell->payload + cell->local_size);
+
+    return 0;
+}
+
+/* Rowid of leaf cell ci, for binary search; cells are sorted by rowid. */
+int64_t leaf_rowid(const unsigned char *hdr, const unsigned char *page, int ci)
+{
+    const unsigned char *p = page + read_be16(hdr + 8 + ci * 2);
+    int l1, l2;
+
+    decode_varint(p, &l1);
+    return (int64_t)decode_varint(p + l1, &l2);
+}
+
+/* Key of interior cell i: the largest rowid held under its left child. */
+int64_t interior_key(const unsigned char *hdr, const unsigned char *page, int i)
+{
+    int len;
+
+    return (int64_t)decode_varint(page + read_be16(hdr + 12 + i * 2) + 4, &len);
+}
+
+/* First index in [0, n) whose key is >= lo, or n. */
+int lower_bound(const unsigned char *hdr, const unsigned char *page, int n, int64_t lo,
+                int64_t (*key)(const unsigned char *, const unsigned char *, int))
+{
+    int l = 0, r = n;
+
+    while (l < r)
+    {
+        int mid = l + (r - l) / 2;
+
+        if (key(hdr, page, mid) < lo)
+            l = mid + 1;
+        else
+            r = mid;
+    }
+
+    return l;
+}
+
+/*
+ * Walks the part of a table b-tree whose rowids lie in [lo, hi], in rowid
+ * order. Interior pages (0x05) are kept on an explicit stack together with
+ * the index of the next child to visit; the first child is found by binary
+ * search on the cell keys and the walk stops once a key reaches hi. Leaves
+ * (0x0D) are searched the same way and hand every cell in range to fn. fn
+ * returns non-zero to stop the scan early.
+ */
+int scan_rowids(struct db *db, uint64_t root, int64_t lo, int64_t hi, table_cell_fn fn, void *arg)
+{
+    struct
+    {
+        uint64_t pgno;
+        int next;
+    } stack[MAX_BTREE_DEPTH];
+    int depth = 0;
+
+    stack[depth].pgno = root;
+    stack[depth].next = -1;
+    ++depth;
+
+    while (depth > 0)
+    {
+        uint64_t pgno = stack[depth - 1].pgno;
+        unsigned char *page = get_page(db, pgno);
+
+        if (!page)
+        {
+            fprintf(stderr, "page %llu out of range\n", (unsigned long long)pgno);
+            return -1;
+        }
+
+        unsigned char *hdr = page + (pgno == 1 ? 100 : 0);
+        int cellcnt = read_be16(hdr + 3);
+
+        if (hdr[0] == 0x0D)
+        {
+            for (int ci = lower_bound(hdr, page, cellcnt, lo, leaf_rowid); ci < cellcnt; ++ci)
+            {
+                struct table_cell cell;
+                int rc = parse_leaf_cell(db, page, hdr, pgno, ci, &cell);
+
+                if (rc > 0)
+                    continue;
+
+                if (rc == 0 && (int64_t)cell.rowid > hi)
+                {
+                    put_page(db, page);
+                    return 0;
+                }
+
+                if (rc < 0 || fn(db, &cell, arg))
+                {
+                    put_page(db, page);
+                    return rc;
+                }
+            }
+
+            put_page(db, page);
+            --depth;
+        }
+        else if (hdr[0] == 0x05)
+        {
+            if (stack[depth - 1].next < 0)
+                stack[depth - 1].next = lower_bound(hdr, page, cellcnt, lo, interior_key);
+
+            int i = stack[depth - 1].next++;
+
+            if (i > cellcnt || (i > 0 && interior_key(hdr, page, i - 1) >= hi))
+            {
+                put_page(db, page);
+                --depth;
+                continue;
+            }
+
+            if (depth == MAX_BTREE_DEPTH)
+            {
+                fprintf(stderr, "b-tree too deep at page %llu\n", (unsigned long long)pgno);
+                put_page(db, page);
+                return -1;
+            }
+
+            if (i < cellcnt && interior_key(hdr, page, i) < hi)
+                prefetch_page(db, interior_child(hdr, page, i + 1));
+
+            stack[depth].pgno = interior_child(hdr, page, i);
+            stack[depth].next = -1;
+            ++depth;
+            put_page(db, page);
+        }
+        else
+        {
+            fprintf(stderr, "page %llu is not a table b-tree page (type=%02x)\n", (unsigned long long)pgno, hdr[0]);
+            put_page(db, page);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int scan_table(struct db *db, uint64_t root, table_cell_fn fn, void *arg)
+{
+    return scan_rowids(db, root, INT64_MIN, INT64_MAX, fn, arg);
+}
+
+/*
+ * Values compared the way SQLite's record comparison does with the BINARY
+ * collation: NULL < INTEGER/REAL < TEXT < BLOB, numbers by value, text and
+ * blobs by memcmp then length.
+ */
+struct sql_value
+{
+    int kind; /* 0 null, 1 integer, 2 real, 3 text, 4 blob */
+    int64_t i;
+    double r;
+    const unsigned char *data;
+    uint64_t len;
+};
+
+void column_to_value(const struct column_value *v, struct sql_value *out)
+{
+    uint64_t st = v->serial;
+
+    out->data = v->data;
+    out->len = v->len;
+
+    if (st == 0)
+        out->kind = 0;
+    else if (st == 7)
+    {
+        out->kind = 2;
+        out->r = read_be_double(v->data);
+    }
+    else if (st <= 9)
+    {
+        out->kind = 1;
+        out->i = column_int(v);
+    }
+    else
+        out->kind = st % 2 ? 3 : 4;
+}
+
+int compare_values(const struct sql_value *a, const struct sql_value *b)
+{
+    int ca = a->kind == 2 ? 1 : a->kind;
+    int cb = b->kind == 2 ? 1 : b->kind;
+
+    if (ca != cb)
+        return ca < cb ? -1 : 1;
+
+    if (ca == 0)
+        return 0;
+
+    if (ca == 1)
+    {
+        if (a->kind == 1 && b->kind == 1)
+            return (a->i > b->i) - (a->i < b->i);
+
+        double x = a->kind == 1 ? (double)a->i : a->r;
+        double y = b->kind == 1 ? (double)b->i : b->r;
+
+        return (x > y) - (x < y);
+    }
+
+    uint64_t n = a->len < b->len ? a->len : b->len;
+    int c = n ? memcmp(a->data, b->data, n) : 0;
+
+    if (c)
+        return c < 0 ? -1 : 1;
+
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+/* Decodes cell ci of an index page (0x02 interior, 0x0A leaf); rowid is left unset. */
+int parse_index_cell(struct db *db, unsigned char *page, const unsigned char *hdr, uint64_t pgno, int ci, struct table_cell *cell)
+{
+    int interior = hdr[0] == 0x02;
+    int cellptr = read_be16(hdr + (interior ? 12 : 8) + ci * 2);
+    int l1;
+
+    if (cellptr <= 0 || cellptr >= db->page_size)
+    {
+        fprintf(stderr, "bad cell pointer %d on index page %llu\n", ci, (unsigned long long)pgno);
+        return -1;
+    }
+
+    unsigned char *p = page + cellptr + (interior ? 4 : 0);
+
+    cell->rowid = 0;
+    cell->payload_size = decode_varint(p, &l1);
+    cell->payload = p + l1;
+    cell->local_size = local_payload_size(db->usable_size, cell->payload_size, 1);
+    cell->overflow = 0;
+
+    if ((uint64_t)(cell->payload - page) + cell->local_size + (cell->local_size < cell->payload_size ? 4 : 0) > (uint64_t)db->page_size)
+    {
+        fprintf(stderr, "cell %d on index page %llu overruns the page\n", ci, (unsigned long long)pgno);
+        return -1;
+    }
+
+    if (cell->local_size < cell->payload_size)
+        cell->overflow = read_be32(cell->payload + cell->local_size);
+
+    return 0;
+}
+
+/*
+ * Compares the first column of index cell ci with key. When want_rowid is
+ * set the trailing rowid of the entry is stored there. Returns -1/0/1, or
+ * -2 if the cell cannot be read.
+ */
+int compare_index_cell(struct db *db, unsigned char *page, const unsigned char *hdr, uint64_t pgno, int ci,
+                       const struct sql_value *key, struct scratch *scratch, int64_t *want_rowid)
+{
+    struct table_cell cell;
+    struct record_cursor c;
+    struct column_value v;
+    struct sql_value first;
+    const unsigned char *record;
+    int rc;
+
+    if (parse_index_cell(db, page, hdr, pgno, ci, &cell) != 0)
+        return -2;
+
+    record = load_payload(db, &cell, scratch);
+
+    if (!record || record_open(&c, record, cell.payload_size) != 0 || record_next(&c, &v) <= 0)
+    {
+        fprintf(stderr, "corrupt index record on page %llu\n", (unsigned long long)pgno);
+        return -2;
+    }
+
+    column_to_value(&v, &first);
+
+    if (want_rowid)
+    {
+        struct column_value last = v;
+
+        while ((rc = record_next(&c, &v)) > 0)
+            last = v;
+
+        if (rc < 0 || last.serial < 1 || last.serial > 9 || last.serial == 7)
+        {
+            fprintf(stderr, "index record on page %llu has no rowid\n", (unsigned long long)pgno);
+            return -2;
+        }
+
+        *want_rowid = column_int(&last);
+    }
+
+    return compare_values(&first, key);
+}
+
+/* Growable list of rowids or page numbers. */
+struct id_list
+{
+    int64_t *ids;
+    size_t count;
+    size_t cap;
+};
+
+int id_push(struct id_list *list, int64_t id)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        int64_t *ids = realloc(list->ids, cap * sizeof(int64_t));
+
+        if (!ids)
+        {
+            fprintf(stderr, "oom\n");
+            return -1;
+        }
+
+        list->ids = ids;
+        list->cap = cap;
+    }
+
+    list->ids[list->count++] = id;
+    return 0;
+}
+
+/*
+ * Collects the rowids of every entry of an index b-tree whose first column
+ * equals key. Unlike table b-trees, interior index cells are entries too, so
+ * the walk is in-order: step 2*i descends into child i and step 2*i+1
+ * examines cell i. Each page starts at the binary-searched first cell not
+ * below key, and the walk ends at the first entry above it.
+ */
+int scan_index(struct db *db, uint64_t root, const struct sql_value *key, struct id_list *out)
+{
+    struct
+    {
+        uint64_t pgno;
+        int next;
+    } stack[MAX_BTREE_DEPTH];
+    struct scratch scratch = { NULL, 0 };
+    int depth = 0, rc = 0;
+
+    stack[depth].pgno = root;
+    stack[depth].next = -1;
+    ++depth;
+
+    while (depth > 0 && rc == 0)
+    {
+        uint64_t pgno = stack[depth - 1].pgno;
+        unsigned char *page = get_page(db, pgno);
+
+        if (!page)
+        {
+            fprintf(stderr, "page %llu out of range\n", (unsigned long long)pgno);
+            rc = -1;
+            break;
+        }
+
+        unsigned char *hdr = page + (pgno == 1 ? 100 : 0);
+        int cellcnt = read_be16(hdr + 3);
+
+        if (hdr[0] != 0x02 && hdr[0] != 0x0A)
+        {
+            fprintf(stderr, "page %llu is not an index b-tree page (type=%02x)\n", (unsigned long long)pgno, hdr[0]);
+            put_page(db, page);
+            rc = -1;
+            break;
+        }
+
+        if (stack[depth - 1].next < 0)
+        {
+            int l = 0, r = cellcnt;
+
+            while (l < r && rc == 0)
+            {
+                int mid = l + (r - l) / 2;
+                int cmp = compare_index_cell(db, page, hdr, pgno, mid, key, &scratch, NULL);
+
+                if (cmp == -2)
+                    rc = -1;
+                else if (cmp < 0)
+                    l = mid + 1;
+                else
+                    r = mid;
+            }
+
+            stack[depth - 1].next = hdr[0] == 0x02 ? 2 * l : l;
+        }
+
+        if (rc != 0)
+        {
+            put_page(db, page);
+            break;
+        }
+
+        if (hdr[0] == 0x0A)
+        {
+            for (int ci = stack[depth - 1].next; ci < cellcnt; ++ci)
+            {
+                int64_t rowid;
+                int cmp = compare_index_cell(db, page, hdr, pgno, ci, key, &scratch, &rowid);
+
+                if (cmp == -2)
+                    rc = -1;
+                else if (cmp > 0)
+                    depth = 0;
+                else if (id_push(out, rowid) != 0)
+                    rc = -1;
+
+                if (rc != 0 || depth == 0)
+                    break;
+            }
+
+            put_page(db, page);
+            if (depth > 0)
+                --depth;
+            continue;
+        }
+
+        int step = stack[depth - 1].next++;
+        int i = step / 2;
+
+        if (i > cellcnt || (step % 2 && i == cellcnt))
+        {
+            put_page(db, page);
+            --depth;
+            continue;
+        }
+
+        if (step % 2)
+        {
+            int64_t rowid;
+            int cmp = compare_index_cell(db, page, hdr, pgno, i, key, &scratch, &rowid);
+
+            if (cmp == -2)
+                rc = -1;
+            else if (cmp > 0)
+                depth = 0;
+            else if (id_push(out, rowid) != 0)
+                rc = -1;
+
+            put_page(db, page);
+            continue;
+        }
+
+        if (depth == MAX_BTREE_DEPTH)
+        {
+            fprintf(stderr, "b-tree too deep at page %llu\n", (unsigned long long)pgno);
+            put_page(db, page);
+            rc = -1;
+            break;
+        }
+
+        stack[depth].pgno = interior_child(hdr, page, i);
+        stack[depth].next = -1;
+        ++depth;
+        put_page(db, page);
+    }
+
+    free(scratch.buf);
+    return rc;
+}
+
+struct index_info
+{
+    char *name;
+    char *sql;
+    uint64_t rootpage;
+};
+
+struct master_lookup
+{
+    const char *target;
+    uint64_t rootpage;
+    int found;
+    char *sql;
+    struct index_info *indexes;
+    int nindexes;
+    int capindexes;
+    struct scratch scratch;
+};
+
+int text_equals(const struct column_value *v, const char *s)
+{
+    return v->serial >= 13 && (v->serial % 2) && v->len == strlen(s) && memcmp(v->data, s, v->len) == 0;
+}
+
+char *copy_text(const struct column_value *v)
+{
+    char *s;
+
+    if (v->serial < 13 || !(v->serial % 2))
+        return NULL;
+
+    s = malloc(v->len + 1);
+    if (s)
+    {
+        memcpy(s, v->data, v->len);
+        s[v->len] = '\0';
+    }
+
+    return s;
+}
+
+/*
+ * sqlite_master rows are (type, name, tbl_name, rootpage, sql). Records the
+ * target table and every index built on it.
+ */
+int find_table_cell(struct db *db, const struct table_cell *cell, void *arg)
+{
+    struct master_lookup *lookup = arg;
+    const unsigned char *record = load_payload(db, cell, &lookup->scratch);
+    struct record_cursor c;
+    struct column_value v, name = { 0, NULL, 0 }, sql = { 0, NULL, 0 };
+    int is_table = 0, is_index = 0, name_match = 0, tbl_match = 0;
+    uint64_t rootpage = 0;
+
+    if (!record || record_open(&c, record, cell->payload_size) != 0)
+        return 0;
+
+    for (int col = 0; col < 5 && record_next(&c, &v) > 0; ++col)
+    {
+        if (col == 0)
+        {
+            is_table = text_equals(&v, "table");
+            is_index = text_equals(&v, "index");
+        }
+        else if (col == 1)
+        {
+            name_match = text_equals(&v, lookup->target);
+            name = v;
+        }
+        else if (col == 2)
+            tbl_match = text_equals(&v, lookup->target);
+        else if (col == 3 && v.serial >= 1 && v.serial <= 6)
+            rootpage = (uint64_t)column_int(&v);
+        else if (col == 4)
+            sql = v;
+    }
+
+    if (is_table && name_match && !lookup->found)
+    {
+        lookup->rootpage = rootpage;
+        lookup->sql = copy_text(&sql);
+        lookup->found = 1;
+    }
+    else if (is_index && tbl_match && rootpage)
+    {
+        if (lookup->nindexes == lookup->capindexes)
+        {
+            int cap = lookup->capindexes ? lookup->capindexes * 2 : 8;
+            struct index_info *ixs = realloc(lookup->indexes, cap * sizeof(struct index_info));
+
+            if (!ixs)
+            {
+                fprintf(stderr, "oom\n");
+                return 1;
+            }
+
+            lookup->indexes = ixs;
+            lookup->capindexes = cap;
+        }
+
+        struct index_info *ix = &lookup->indexes[lookup->nindexes++];
+
+        ix->name = copy_text(&name);
+        ix->sql = copy_text(&sql);
+        ix->rootpage = rootpage;
+    }
+
+    return 0;
+}
+
+void free_lookup(struct master_lookup *lookup)
+{
+    for (int i = 0; i < lookup->nindexes; ++i)
+    {
+        free(lookup->indexes[i].name);
+        free(lookup->indexes[i].sql);
+    }
+
+    free(lookup->indexes);
+    free(lookup->sql);
+    free(lookup->scratch.buf);
+}
+
+/* Column affinities (datatype3 section 3.1). */
+enum affinity { AFF_BLOB, AFF_TEXT, AFF_NUMERIC, AFF_INTEGER, AFF_REAL };
+
+struct column_def
+{
+    char name[128];
+    enum affinity affinity;
+    int rowid_alias;
+    int binary;
+};
+
+const char *skip_space(const char *p)
+{
+    while (*p && isspace((unsigned char)*p))
+        ++p;
+
+    return p;
+}
+
+/* Reads a bare or quoted identifier into out; returns the position after it, or NULL. */
+const char *read_ident(const char *p, char *out, size_t cap)
+{
+    size_t n = 0;
+
+    p = skip_space(p);
+
+    if (*p == '"' || *p == '`' || *p == '[' || *p == '\'')
+    {
+        char close = *p == '[' ? ']' : *p;
+
+        for (++p; *p; ++p)
+        {
+            if (*p == close)
+            {
+                if (close == ']' || p[1] != close)
+                    break;
+                ++p;
+            }
+
+            if (n + 1 < cap)
+                out[n++] = *p;
+        }
+
+        if (!*p)
+            return NULL;
+        ++p;
+    }
+    else
+    {
+        while (*p && (isalnum((unsigned char)*p) || *p == '_' || *p == '$'))
+        {
+            if (n + 1 < cap)
+                out[n++] = *p;
+            ++p;
+        }
+
+        if (n == 0)
+            return NULL;
+    }
+
+    out[n] = '\0';
+    return p;
+}
+
+/* End of a column definition or index term: the next top-level ',' or ')'. */
+const char *term_end(const char *p)
+{
+    int depth = 0;
+
+    for (; *p; ++p)
+    {
+        if (*p == '\'' || *p == '"' || *p == '`' || *p == '[')
+        {
+            char close = *p == '[' ? ']' : *p;
+
+            for (++p; *p && *p != close; ++p)
+                ;
+            if (!*p)
+                break;
+        }
+        else if (*p == '(')
+            ++depth;
+        else if (*p == ')' && depth-- == 0)
+            break;
+        else if (*p == ',' && depth == 0)
+            break;
+    }
+
+    return p;
+}
+
+int is_keyword(const char *word, const char *const *list)
+{
+    for (; *list; ++list)
+        if (strcasecmp(word, *list) == 0)
+            return 1;
+
+    return 0;
+}
+
+int contains_nocase(const char *s, size_t n, const char *needle)
+{
+    size_t k = strlen(needle);
+
+    for (size_t i = 0; i + k <= n; ++i)
+        if (strncasecmp(s + i, needle, k) == 0)
+            return 1;
+
+    return 0;
+}
+
+enum affinity type_affinity(const char *type, size_t n)
+{
+    if (contains_nocase(type, n, "INT"))
+        return AFF_INTEGER;
+    if (contains_nocase(type, n, "CHAR") || contains_nocase(type, n, "CLOB") || contains_nocase(type, n, "TEXT"))
+        return AFF_TEXT;
+    if (n == 0 || contains_nocase(type, n, "BLOB"))
+        return AFF_BLOB;
+    if (contains_nocase(type, n, "REAL") || contains_nocase(type, n, "FLOA") || contains_nocase(type, n, "DOUB"))
+        return AFF_REAL;
+
+    return AFF_NUMERIC;
+}
+
+/* Parses the column list of a CREATE TABLE statement into a malloc'd array. Returns the column count, or -1. */
+int table_columns(const char *sql, struct column_def **out)
+{
+    static const char *const table_constraints[] = { "CONSTRAINT", "PRIMARY", "UNIQUE", "CHECK", "FOREIGN", NULL };
+    static const char *const column_constraints[] = { "CONSTRAINT", "PRIMARY", "NOT", "NULL", "UNIQUE", "CHECK",
+                                                      "DEFAULT", "COLLATE", "REFERENCES", "GENERATED", "AS", NULL };
+    const char *p = sql ? strchr(sql, '(') : NULL;
+    struct column_def *cols = NULL;
+    int n = 0, cap = 0;
+
+    *out = NULL;
+    if (!p)
+        return -1;
+
+    while (*p == '(' || *p == ',')
+    {
+        char word[128];
+        const char *end = term_end(++p);
+        const char *q = read_ident(p, word, sizeof(word));
+        const char *type, *type_end;
+
+        if (!q || q > end || is_keyword(word, table_constraints))
+            break;
+
+        if (n == cap)
+        {
+            struct column_def *grown = realloc(cols, (cap = cap ? cap * 2 : 16) * sizeof(struct column_def));
+
+            if (!grown)
+            {
+                fprintf(stderr, "oom\n");
+                free(cols);
+                return -1;
+            }
+
+            cols = grown;
+        }
+
+        struct column_def *col = &cols[n++];
+
+        strcpy(col->name, word);
+
+        type = type_end = skip_space(q);
+        while (type_end < end)
+        {
+            const char *w = read_ident(type_end, word, sizeof(word));
+
+            if (!w || w > end || is_keyword(word, column_constraints))
+                break;
+
+            type_end = skip_space(w);
+            if (*type_end == '(')
+                type_end = skip_space(term_end(type_end + 1) + 1);
+        }
+
+        /* The declared collation; an index on the column inherits it. */
+        col->binary = 1;
+        for (const char *t = skip_space(type_end); t < end; t = skip_space(t))
+        {
+            const char *w = *t == '(' ? term_end(t + 1) + 1 : read_ident(t, word, sizeof(word));
+
+            if (!w || w > end)
+                break;
+
+            if (*t != '(' && strcasecmp(word, "COLLATE") == 0)
+            {
+                const char *c = read_ident(w, word, sizeof(word));
+
+                if (!c || c > end)
+                    break;
+                col->binary = strcasecmp(word, "BINARY") == 0;
+                w = c;
+            }
+            t = w;
+        }
+
+        col->affinity = type_affinity(type, type_end - type);
+        col->rowid_alias = type_end - type >= 7 && strncasecmp(type, "INTEGER", 7) == 0 &&
+                           skip_space(type + 7) == type_end &&
+                           contains_nocase(q, end - q, "PRIMARY") && !contains_nocase(q, end - q, "DESC");
+        p = end;
+    }
+
+    *out = cols;
+    return n;
+}
+
+/*
+ * Leading column of a CREATE INDEX statement, or 0 when the index cannot
+ * answer an equality lookup on it in key order: partial indexes,
+ * expressions, DESC and non-BINARY collations. Returns 2 when the index
+ * says COLLATE BINARY itself, 1 when it inherits the column's collation.
+ */
+int index_first_column(const char *sql, char *out, size_t cap)
+{
+    static const char *const modifiers[] = { "ASC", NULL };
+    const char *p = sql ? strchr(sql, '(') : NULL;
+    const char *end, *q;
+    char word[64];
+    int binary = 0;
+
+    if (!p || contains_nocase(sql, strlen(sql), " WHERE "))
+        return 0;
+
+    end = term_end(++p);
+    q = read_ident(p, out, cap);
+    if (!q || q > end)
+        return 0;
+
+    for (q = skip_space(q); q < end; q = skip_space(q))
+    {
+        q = read_ident(q, word, sizeof(word));
+        if (!q || q > end)
+            return 0;
+
+        if (strcasecmp(word, "COLLATE") == 0)
+        {
+            q = read_ident(q, word, sizeof(word));
+            if (!q || q > end || strcasecmp(word, "BINARY") != 0)
+                return 0;
+            binary = 1;
+        }
+        else if (!is_keyword(word, modifiers))
+            return 0;
+    }
+
+    return binary ? 2 : 1;
+}
+
+/*
+ * Turns a command-line literal into a value the way the column's affinity
+ * would store it. A quoted literal is text, except that numeric affinities
+ * convert it when it spells a number, as SQLite does: n = '5' matches 5.
+ */
+void parse_literal(const char *text, enum affinity aff, struct sql_value *out)
+{
+    size_t n = strlen(text);
+    const char *num = text;
+    char buf[64], *end;
+
+    out->data = (const unsigned char *)text;
+    out->len = n;
+    out->kind = 3;
+
+    if (n >= 2 && text[0] == '\'' && text[n - 1] == '\'')
+    {
+        out->data++;
+        out->len -= 2;
+
+        if (aff == AFF_TEXT || aff == AFF_BLOB || out->len == 0 || out->len >= sizeof(buf))
+            return;
+
+        memcpy(buf, out->data, out->len);
+        buf[out->len] = '\0';
+        num = buf;
+    }
+    else if (aff == AFF_TEXT || n == 0)
+        return;
+
+    /* strtod would also take hex, inf and nan, which SQLite keeps as text. */
+    if (strpbrk(num, "xXnNiI"))
+        return;
+
+    out->i = strtoll(num, &end, 10);
+    if (!*end)
+    {
+        out->kind = 1;
+        return;
+    }
+
+    out->r = strtod(num, &end);
+    if (!*end)
+    {
+        out->kind = 2;
+        if (aff != AFF_REAL && out->r == (double)(int64_t)out->r)
+        {
+            out->kind = 1;
+            out->i = (int64_t)out->r;
+        }
+    }
+}
+
+enum out_format { FMT_TEXT, FMT_CSV, FMT_TSV, FMT_BINARY };
+
+void out_le32(struct outbuf *ob, uint32_t v)
+{
+    unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+
+    out_write(ob, b, 4);
+}
+
+void out_le64(struct outbuf *ob, uint64_t v)
+{
+    out_le32(ob, (uint32_t)v);
+    out_le32(ob, (uint32_t)(v >> 32));
+}
+
+/* Zero bytes up to the next multiple of 8 after n written bytes. */
+void out_pad8(struct outbuf *ob, uint64_t n)
+{
+    static const unsigned char zeros[8];
+
+    out_write(ob, zeros, (8 - n % 8) % 8);
+}
+
+/*
+ * Binary columnar output. The stream starts with "SQLCOLS1", a u32 column
+ * count and, per column, a u32 name length and the name, padded to 8 bytes.
+ * Then come batches of up to BATCH_ROWS rows: u32 rows, u32 columns, u64
+ * bytes that follow, then for every column
+ *   types[rows]      u8 per value: 0 null, 1 integer, 2 real, 3 text, 4 blob
+ *   slots[rows]      u64: the integer, or the bits of the double
+ *   offsets[rows+1]  u32 into the heap; text/blob value i is [off[i], off[i+1])
+ *   heap             the string bytes
+ * each section zero-padded to 8 bytes. All integers are little-endian.
+ */
+#define BATCH_ROWS 4096
+#define BATCH_HEAP_BYTES (4 << 20)
+
+struct batch_column
+{
+    unsigned char *types;
+    uint64_t *slots;
+    uint32_t *offsets;
+    struct outbuf heap;
+};
+
+struct batch
+{
+    int ncols;
+    size_t nrows;
+    size_t heap_bytes;
+    struct batch_column *cols;
+};
+
+void batch_free(struct batch *b)
+{
+    for (int i = 0; b->cols && i < b->ncols; ++i)
+    {
+        free(b->cols[i].types);
+        free(b->cols[i].slots);
+        free(b->cols[i].offsets);
+        free(b->cols[i].heap.data);
+    }
+
+    free(b->cols);
+    memset(b, 0, sizeof(*b));
+}
+
+int batch_init(struct batch *b, int ncols)
+{
+    memset(b, 0, sizeof(*b));
+    b->cols = calloc(ncols, sizeof(struct batch_column));
+    if (!b->cols)
+    {
+        fprintf(stderr, "oom\n");
+        return -1;
+    }
+
+    b->ncols = ncols;
+
+    for (int i = 0; i < ncols; ++i)
+    {
+        struct batch_column *c = &b->cols[i];
+
+        c->types = malloc(BATCH_ROWS);
+        c->slots = malloc(BATCH_ROWS * sizeof(uint64_t));
+        c->offsets = calloc(BATCH_ROWS + 1, sizeof(uint32_t));
+
+        if (!c->types || !c->slots || !c->offsets)
+        {
+            fprintf(stderr, "oom\n");
+            batch_free(b);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void batch_put(struct batch *b, int col, const struct sql_value *v)
+{
+    struct batch_column *c = &b->cols[col];
+    size_t r = b->nrows;
+
+    c->types[r] = v->kind;
+    c->slots[r] = 0;
+
+    if (v->kind == 1)
+        c->slots[r] = (uint64_t)v->i;
+    else if (v->kind == 2)
+        memcpy(&c->slots[r], &v->r, 8);
+    else if (v->kind >= 3)
+    {
+        out_write(&c->heap, v->data, v->len);
+        b->heap_bytes += v->len;
+    }
+
+    c->offsets[r + 1] = c->heap.len;
+}
+
+void batch_flush(struct batch *b, struct outbuf *ob)
+{
+    uint64_t rows = b->nrows, bytes = 0;
+
+    if (!rows)
+        return;
+
+    for (int i = 0; i < b->ncols; ++i)
+        bytes += (rows + 7) / 8 * 8 + rows * 8 + (4 * (rows + 1) + 7) / 8 * 8 + (b->cols[i].heap.len + 7) / 8 * 8;
+
+    out_le32(ob, rows);
+    out_le32(ob, b->ncols);
+    out_le64(ob, bytes);
+
+    for (int i = 0; i < b->ncols; ++i)
+    {
+        struct batch_column *c = &b->cols[i];
+
+        out_write(ob, c->types, rows);
+        out_pad8(ob, rows);
+        for (size_t r = 0; r < rows; ++r)
+            out_le64(ob, c->slots[r]);
+        for (size_t r = 0; r <= rows; ++r)
+            out_le32(ob, c->offsets[r]);
+        out_pad8(ob, 4 * (rows + 1));
+        out_write(ob, c->heap.data, c->heap.len);
+        out_pad8(ob, c->heap.len);
+
+        c->heap.len = 0;
+        if (c->heap.failed)
+            ob->failed = 1;
+    }
+
+    b->nrows = 0;
+    b->heap_bytes = 0;
+}
+
+void out_hex(struct outbuf *ob, const unsigned char *p, uint64_t n)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        out_char(ob, digits[p[i] >> 4]);
+        out_char(ob, digits[p[i] & 15]);
+    }
+}
+
+/*
+ * One CSV (RFC 4180) or TSV field. CSV quotes text containing the
+ * separator, quotes or line breaks; TSV backslash-escapes them instead.
+ * NULL is the empty field, reals round-trip and always show a '.' or an
+ * exponent, blobs are written as hex.
+ */
+void out_field(struct outbuf *ob, const struct sql_value *v, enum out_format format)
+{
+    if (v->kind == 1)
+        out_int(ob, v->i);
+    else if (v->kind == 2)
+    {
+        size_t start = ob->len;
+
+        out_double(ob, v->r, 17, "%.17g");
+
+        /* Like sqlite3, keep integral reals recognisable as reals: 1 -> 1.0. */
+        if (!ob->failed && !memchr(ob->data + start, '.', ob->len - start) &&
+            !memchr(ob->data + start, 'e', ob->len - start) && !memchr(ob->data + start, 'n', ob->len - start))
+            out_str(ob, ".0");
+    }
+    else if (v->kind == 4)
+        out_hex(ob, v->data, v->len);
+    else if (v->kind == 3 && format == FMT_TSV)
+    {
+        for (uint64_t i = 0; i < v->len; ++i)
+        {
+            char ch = v->data[i];
+
+            if (ch == '\t' || ch == '\n' || ch == '\r' || ch == '\\')
+            {
+                out_char(ob, '\\');
+                ch = ch == '\t' ? 't' : ch == '\n' ? 'n' : ch == '\r' ? 'r' : '\\';
+            }
+            out_char(ob, ch);
+        }
+    }
+    else if (v->kind == 3)
+    {
+        int quote = 0;
+
+        for (uint64_t i = 0; i < v->len && !quote; ++i)
+            quote = v->data[i] == ',' || v->data[i] == '"' || v->data[i] == '\n' || v->data[i] == '\r';
+
+        if (!quote)
+        {
+            out_write(ob, v->data, v->len);
+            return;
+        }
+
+        out_char(ob, '"');
+        for (uint64_t i = 0; i < v->len; ++i)
+        {
+            if (v->data[i] == '"')
+                out_char(ob, '"');
+            out_char(ob, v->data[i]);
+        }
+        out_char(ob, '"');
+    }
+}
+
+struct row_printer
+{
+    struct scratch scratch;
+    uint64_t rows;
+    struct outbuf *ob;
+    enum out_format format;
+    struct batch batch;
+};
+
+/* Ends a run of rows: pending batch rows are written out. */
+void finish_rows(struct row_printer *out)
+{
+    if (out->format == FMT_BINARY)
+        batch_flush(&out->batch, out->ob);
+}
+
+int count_table_cell(struct db *db, const struct table_cell *cell, void *arg)
+{
+    (void)db;
+    (void)cell;
+    ++*(uint64_t *)arg;
+    return 0;
+}
+
+int print_table_cell(struct db *db, const struct table_cell *cell, void *arg)
+{
+    struct row_printer *out = arg;
+    const unsigned char *record = load_payload(db, cell, &out->scratch);
+
+    if (!record)
+        return 1;
+
+    out_str(out->ob, "rowid=");
+    out_uint(out->ob, cell->rowid);
+    out_str(out->ob, ": ");
+    print_record(out->ob, record, (int)cell->payload_size);
+    out->rows++;
+
+    return out_row_done(out->ob);
+}
+
+enum pred_op { OP_EQ, OP_LT, OP_GT, OP_LE, OP_GE, OP_ISNULL, OP_NOTNULL };
+
+/* column is an index into the table's columns, or -1 for the rowid. */
+struct predicate
+{
+    int column;
+    enum pred_op op;
+    struct sql_value key;
+};
+
+/*
+ * A projection plus a conjunction of predicates over one table. Only the
+ * columns some predicate or the select list needs get a slot in values;
+ * the record header is walked once up to max_column and every other body
+ * is stepped over by its serial-type size without being read.
+ */
+struct query
+{
+    const struct column_def *cols;
+    int *slot;
+    int max_column;
+    int rowid_alias;
+    struct column_value *values;
+    int nvalues;
+    struct predicate *preds;
+    int npreds;
+    int *select;
+    int nselect;
+    struct row_printer *out;
+};
+
+/* Splits "col OP value" / "col IS [NOT] NULL"; name is written in place. */
+int parse_predicate(char *text, char **name, enum pred_op *op, char **value)
+{
+    char *p = text, *end;
+
+    while (*p && !strchr("=<>", *p) && !(isspace((unsigned char)*p) && strncasecmp(skip_space(p), "IS ", 3) == 0))
+        ++p;
+
+    if (!*p || p == text)
+        return -1;
+
+    for (end = p; end > text && isspace((unsigned char)end[-1]); --end)
+        ;
+
+    *name = text;
+
+    if (*p == '=' || *p == '<' || *p == '>')
+    {
+        *op = *p == '=' ? OP_EQ : *p == '<' ? (p[1] == '=' ? OP_LE : OP_LT) : (p[1] == '=' ? OP_GE : OP_GT);
+        *value = (char *)skip_space(p + (*op == OP_LE || *op == OP_GE ? 2 : 1));
+
+        /* <>, !=, == and the like are not supported; do not read them as "col < '>5'". */
+        if (!**value || strchr("=<>!", **value) || end[-1] == '!')
+            return -1;
+
+        *end = '\0';
+        return 0;
+    }
+
+    p = (char *)skip_space(skip_space(p) + 3);
+    *op = OP_ISNULL;
+    if (strncasecmp(p, "NOT", 3) == 0 && isspace((unsigned char)p[3]))
+    {
+        *op = OP_NOTNULL;
+        p = (char *)skip_space(p + 3);
+    }
+
+    *end = '\0';
+    *value = NULL;
+    return strcasecmp(p, "NULL") == 0 ? 0 : -1;
+}
+
+void query_value(const struct query *q, int column, int64_t rowid, struct sql_value *out)
+{
+    if (column < 0 || column == q->rowid_alias)
+    {
+        out->kind = 1;
+        out->i = rowid;
+        return;
+    }
+
+    column_to_value(&q->values[q->slot[column]], out);
+
+    /* REAL columns may store integral values as integers (file format 2.1). */
+    if (out->kind == 1 && q->cols[column].affinity == AFF_REAL)
+    {
+        out->kind = 2;
+        out->r = (double)out->i;
+    }
+}
+
+int query_matches(const struct query *q, int64_t rowid)
+{
+    for (int i = 0; i < q->npreds; ++i)
+    {
+        const struct predicate *p = &q->preds[i];
+        struct sql_value v;
+        int cmp;
+
+        query_value(q, p->column, rowid, &v);
+
+        if (p->op == OP_ISNULL || p->op == OP_NOTNULL)
+        {
+            if ((v.kind == 0) != (p->op == OP_ISNULL))
+                return 0;
+            continue;
+        }
+
+        if (v.kind == 0)
+            return 0;
+
+        cmp = compare_values(&v, &p->key);
+
+        if ((p->op == OP_EQ && cmp != 0) || (p->op == OP_LT && cmp >= 0) || (p->op == OP_GT && cmp <= 0) ||
+            (p->op == OP_LE && cmp > 0) || (p->op == OP_GE && cmp < 0))
+            return 0;
+    }
+
+    return 1;
+}
+
+int query_row(struct db *db, const struct table_cell *cell, void *arg)
+{
+    struct query *q = arg;
+    const unsigned char *record = NULL;
+    int64_t rowid = (int64_t)cell->rowid;
+
+    for (int i = 0; i < q->nvalues; ++i)
+        q->values[i].serial = 0;
+
+    if (q->max_column >= 0 || q->nselect == 0)
+    {
+        struct record_cursor c;
+        struct column_value v;
+        int rc = 1;
+
+        record = load_payload(db, cell, &q->out->scratch);
+
+        if (!record || record_open(&c, record, cell->payload_size) != 0)
+            return 1;
+
+        for (int col = 0; col <= q->max_column && (rc = record_next(&c, &v)) > 0; ++col)
+            if (q->slot[col] >= 0)
+                q->values[q->slot[col]] = v;
+
+        if (rc < 0)
+        {
+            fprintf(stderr, "corrupt record at rowid %lld\n", (long long)rowid);
+            return 1;
+        }
+    }
+
+    if (!query_matches(q, rowid))
+        return 0;
+
+    struct row_printer *out = q->out;
+    struct outbuf *ob = out->ob;
+    struct sql_value v;
+
+    out->rows++;
+
+    if (out->format == FMT_BINARY)
+    {
+        for (int i = 0; i < q->nselect; ++i)
+        {
+            query_value(q, q->select[i], rowid, &v);
+            batch_put(&out->batch, i, &v);
+        }
+
+        if (++out->batch.nrows == BATCH_ROWS || out->batch.heap_bytes >= BATCH_HEAP_BYTES)
+            batch_flush(&out->batch, ob);
+
+        return out_row_done(ob);
+    }
+
+    if (out->format != FMT_TEXT)
+    {
+        for (int i = 0; i < q->nselect; ++i)
+        {
+            if (i)
+                out_char(ob, out->format == FMT_CSV ? ',' : '\t');
+
+            query_value(q, q->select[i], rowid, &v);
+            out_field(ob, &v, out->format);
+        }
+
+        out_char(ob, '\n');
+        return out_row_done(ob);
+    }
+
+    out_str(ob, "rowid=");
+    out_uint(ob, cell->rowid);
+    out_str(ob, ": ");
+
+    if (q->nselect == 0)
+    {
+        print_record(ob, record, (int)cell->payload_size);
+        return out_row_done(ob);
+    }
+
+    for (int i = 0; i < q->nselect; ++i)
+    {
+        int col = q->select[i];
+
+        if (i)
+            out_str(ob, " | ");
+
+        if (col < 0 || col == q->rowid_alias)
+            out_int(ob, rowid);
+        else
+            print_value(ob, &q->values[q->slot[col]]);
+    }
+
+    out_char(ob, '\n');
+    return out_row_done(ob);
+}
+
+/* Column number of name, -1 for a rowid alias that is not a declared column, -2 if unknown. */
+int find_column(const struct column_def *cols, int ncols, const char *name)
+{
+    for (int i = 0; i < ncols; ++i)
+        if (strcasecmp(cols[i].name, name) == 0)
+            return i;
+
+    if (strcasecmp(name, "rowid") == 0 || strcasecmp(name, "_rowid_") == 0 || strcasecmp(name, "oid") == 0)
+        return -1;
+
+    fprintf(stderr, "no such column: %s\n", name);
+    return -2;
+}
+
+/* Registers col in the query's slot map; col < 0 (rowid) needs no slot. */
+void query_need(struct query *q, int col)
+{
+    if (col < 0 || col == q->rowid_alias || q->slot[col] >= 0)
+        return;
+
+    q->slot[col] = q->nvalues++;
+    if (col > q->max_column)
+        q->max_column = col;
+}
+
+struct scan_options
+{
+    const char *fname;
+    size_t cache_bytes;
+    int use_mmap;
+    int verbose;
+    int threads;
+    int unordered;
+    enum out_format format;
+};
+
+/*
+ * Leaf pages of a table b-tree whose rowids may fall in [lo, hi], in key
+ * order. All children of an interior page sit at the same depth, so the
+ * tree is read one level at a time and only interior pages are visited.
+ */
+int collect_leaves(struct db *db, uint64_t root, int64_t lo, int64_t hi, struct id_list *leaves)
+{
+    struct id_list level = { NULL, 0, 0 }, next = { NULL, 0, 0 };
+    int rc = id_push(&level, root);
+
+    for (int depth = 0; rc == 0; ++depth)
+    {
+        unsigned char *page = get_page(db, level.ids[0]);
+        unsigned char *hdr;
+        int type;
+
+        if (!page)
+        {
+            fprintf(stderr, "page %llu out of range\n", (unsigned long long)level.ids[0]);
+            rc = -1;
+            break;
+        }
+
+        type = page[level.ids[0] == 1 ? 100 : 0];
+        put_page(db, page);
+
+        if (type == 0x0D)
+        {
+            *leaves = level;
+            level.ids = NULL;
+            break;
+        }
+
+        if (depth == MAX_BTREE_DEPTH)
+        {
+            fprintf(stderr, "b-tree too deep at page %llu\n", (unsigned long long)root);
+            rc = -1;
+            break;
+        }
+
+        next.count = 0;
+
+        for (size_t k = 0; k < level.count && rc == 0; ++k)
+        {
+            uint64_t pgno = level.ids[k];
+
+            if (!(page = get_page(db, pgno)))
+            {
+                fprintf(stderr, "page %llu out of range\n", (unsigned long long)pgno);
+                rc = -1;
+                break;
+            }
+
+            hdr = page + (pgno == 1 ? 100 : 0);
+
+            if (hdr[0] != 0x05)
+            {
+                fprintf(stderr, "page %llu is not an interior table page (type=%02x)\n", (unsigned long long)pgno, hdr[0]);
+                rc = -1;
+            }
+            else
+            {
+                int cellcnt = read_be16(hdr + 3);
+
+                for (int i = lower_bound(hdr, page, cellcnt, lo, interior_key); i <= cellcnt && rc == 0; ++i)
+                {
+                    if (i > 0 && interior_key(hdr, page, i - 1) >= hi)
+                        break;
+
+                    rc = id_push(&next, interior_child(hdr, page, i));
+                }
+            }
+
+            put_page(db, page);
+        }
+
+        struct id_list tmp = level;
+
+        level = next;
+        next = tmp;
+
+        if (level.count == 0)
+        {
+            *leaves = level;
+            level.ids = NULL;
+            break;
+        }
     }
 
-    int ncols = 0;
-    hdrpos = hlensz;
-    uint64_t serials[64];
-    while(hdrpos < (int) header_sz && ncols < 64)
+    free(level.ids);
+    free(next.ids);
+    return rc;
+}
+
+/*
+ * Ordered scans hand out leaves SCAN_CHUNK at a time from a shared cursor,
+ * and a worker waits before taking a chunk that starts SCAN_AHEAD or more
+ * leaves past the merge position, so buffered output stays near that many
+ * leaves no matter how large the table is.
+ */
+#define SCAN_CHUNK 4
+#define SCAN_AHEAD 64
+
+/* A worker's share of the leaf list, [begin, end). Thieves take the upper half. */
+struct steal_range
+{
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+};
+
+struct leaf_output
+{
+    char *data;
+    size_t len;
+    int done;
+};
+
+struct parallel_scan
+{
+    const struct scan_options *opts;
+    int page_size;
+    int usable_size;
+    int64_t lo;
+    int64_t hi;
+    const struct query *query;
+    const struct id_list *leaves;
+    struct steal_range *ranges;
+    struct leaf_output *slots;
+    size_t next;
+    size_t merged;
+    size_t ahead;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int failed;
+    uint64_t rows;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+struct scan_worker
+{
+    struct parallel_scan *scan;
+    int id;
+    pthread_t thread;
+};
+
+/* Next chunk of an ordered scan for own; -1 when there is none left or the scan failed. */
+long next_chunk(struct parallel_scan *scan, struct steal_range *own)
+{
+    size_t count = scan->leaves->count;
+    long k = -1;
+
+    pthread_mutex_lock(&scan->lock);
+    while (!scan->failed && scan->next < count && scan->next >= scan->merged + scan->ahead)
+        pthread_cond_wait(&scan->ready, &scan->lock);
+
+    if (!scan->failed && scan->next < count)
     {
-        int stlen; serials[ncols] = decode_varint(record + hdrpos, &stlen);
-        hdrpos += stlen; 
-        ++ncols;
+        k = scan->next;
+        scan->next = count - scan->next < SCAN_CHUNK ? count : scan->next + SCAN_CHUNK;
+
+        pthread_mutex_lock(&own->lock);
+        own->begin = k + 1;
+        own->end = scan->next;
+        pthread_mutex_unlock(&own->lock);
     }
+    pthread_mutex_unlock(&scan->lock);
+
+    return k;
+}
 
-    int bodypos = header_sz;
-    for(int i = 0; i < ncols; ++i) 
+/*
+ * Next leaf index for worker id: its own range first, then half of someone
+ * else's, or in an ordered scan the next chunk near the merge position.
+ */
+long next_leaf(struct parallel_scan *scan, int id)
+{
+    struct steal_range *own = &scan->ranges[id];
+    int n = scan->opts->threads;
+    long k = -1;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->begin < own->end)
+        k = own->begin++;
+    pthread_mutex_unlock(&own->lock);
+
+    if (k < 0 && !scan->opts->unordered)
+        return next_chunk(scan, own);
+
+    for (int i = 1; i < n && k < 0; ++i)
     {
-        uint64_t st = serials[i];
+        struct steal_range *victim = &scan->ranges[(id + i) % n];
+        size_t begin = 0, end = 0;
 
-        if (!st)
-            continue;
-        else if (st >= 1 && st <= 6)
+        pthread_mutex_lock(&victim->lock);
+        if (victim->begin < victim->end)
         {
-            int sz;
-            if (st == 1)
-                sz = 1;
-            else if (st == 2)
-                sz = 2;
-            else if (st == 3)
-                sz = 3;
-            else if (st == 4)
-                sz = 4;
-            else if (st == 5)
-                sz = 6;
-            else 
-                sz = 8;
+            end = victim->end;
+            begin = victim->begin + (victim->end - victim->begin) / 2;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
 
-            int64_t val = read_be_signed(record + bodypos, sz);
-            printf("%lld", (long long) val);
-            bodypos += sz;
-        } 
-        else if(st == 7)
+        if (begin < end)
         {
-            double d;
-            memcpy(&d, record + bodypos, 8);
-            printf("%g", d);
-            bodypos += 8;
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin + 1;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            k = begin;
         }
-        else if (st >= 13 && (st % 2))
+    }
+
+    return k;
+}
+
+void scan_fail(struct parallel_scan *scan)
+{
+    pthread_mutex_lock(&scan->lock);
+    scan->failed = 1;
+    pthread_cond_broadcast(&scan->ready);
+    pthread_mutex_unlock(&scan->lock);
+}
+
+int scan_failed(struct parallel_scan *scan)
+{
+    pthread_mutex_lock(&scan->lock);
+    int failed = scan->failed;
+    pthread_mutex_unlock(&scan->lock);
+
+    return failed;
+}
+
+/*
+ * Each worker owns a pager (its own descriptor and a share of the cache),
+ * a scratch buffer, its query values and an output buffer. In ordered mode
+ * the rows of each leaf are handed to the merging thread; unordered workers
+ * write whole buffers straight to stdout.
+ */
+void *scan_worker_main(void *arg)
+{
+    struct scan_worker *w = arg;
+    struct parallel_scan *scan = w->scan;
+    const struct scan_options *opts = scan->opts;
+    struct pager pager;
+    struct outbuf ob = { NULL, 0, 0, opts->unordered ? stdout : NULL, 0 };
+    struct row_printer out = { { NULL, 0 }, 0, &ob, opts->format, { 0, 0, 0, NULL } };
+    struct query q;
+    size_t cache = opts->cache_bytes / opts->threads;
+    int rc = 0;
+    long k;
+
+    if (pager_open(&pager, opts->fname, cache, opts->use_mmap) != 0)
+    {
+        scan_fail(scan);
+        return NULL;
+    }
+
+    struct db db = { &pager, scan->page_size, scan->usable_size };
+
+    if (scan->query)
+    {
+        q = *scan->query;
+        q.out = &out;
+        q.values = calloc(q.nvalues + 1, sizeof(struct column_value));
+        if (!q.values)
         {
-            int tlen = (st - 13) / 2;
-            printf("\'%.*s\'", tlen, (const char*)(record + bodypos));
-            bodypos += tlen;
+            fprintf(stderr, "oom\n");
+            rc = -1;
         }
-        else if(st >= 12 && !(st % 2))
+        else if (out.format == FMT_BINARY)
+            rc = batch_init(&out.batch, q.nselect);
+    }
+
+    while (rc == 0 && !scan_failed(scan) && (k = next_leaf(scan, w->id)) >= 0)
+    {
+        uint64_t leaf = scan->leaves->ids[k];
+
+        if (scan->query)
+            rc = scan_rowids(&db, leaf, scan->lo, scan->hi, query_row, &q);
+        else
+            rc = scan_rowids(&db, leaf, scan->lo, scan->hi, print_table_cell, &out);
+
+        finish_rows(&out);
+
+        if (rc == 0 && ob.failed)
+            rc = -1;
+
+        if (!opts->unordered)
         {
-            int blen = (st - 12) / 2;
-            printf("BLOB(%d)", blen); 
-            bodypos += blen;
-        }
-        else if (st == 8)
-            printf("0");
-        else if (st == 9)
-            printf("1");
+            pthread_mutex_lock(&scan->lock);
+            scan->slots[k].data = ob.data;
+            scan->slots[k].len = ob.len;
+            scan->slots[k].done = 1;
+            pthread_cond_broadcast(&scan->ready);
+            pthread_mutex_unlock(&scan->lock);
 
-        if (i + 1 < ncols)
-            printf(" | ");
+            ob.data = NULL;
+            ob.len = ob.cap = 0;
+        }
     }
 
-    printf("\n");
+    out_flush(&ob);
+
+    if (rc != 0 || ob.failed)
+        scan_fail(scan);
+
+    pthread_mutex_lock(&scan->lock);
+    scan->rows += out.rows;
+    scan->hits += pager.hits;
+    scan->misses += pager.misses;
+    pthread_mutex_unlock(&scan->lock);
+
+    if (scan->query)
+        free(q.values);
+    batch_free(&out.batch);
+    free(ob.data);
+    free(out.scratch.buf);
+    pager_close(&pager);
+    return NULL;
 }
 
-int main(int argc, char **argv)
+/*
+ * Scans the rowids [lo, hi] of a table with opts->threads workers. Unordered,
+ * the leaf list is split into one contiguous range per worker and idle
+ * workers steal the upper half of a busy worker's range. Ordered, workers
+ * take small chunks just ahead of the merge, which happens here, leaf by
+ * leaf, as each leaf's rows become ready.
+ */
+int parallel_scan(struct db *db, const struct scan_options *opts, uint64_t root, int64_t lo, int64_t hi,
+                  const struct query *query, struct row_printer *out)
 {
-    if (argc < 3){
-        fprintf(stderr, "Usage: %s <dbfile> <table_name>\n", argv[0]);
-        return 2;
+    struct id_list leaves = { NULL, 0, 0 };
+    struct parallel_scan scan;
+    struct scan_worker *workers;
+    int n = opts->threads, started = 0;
+
+    if (collect_leaves(db, root, lo, hi, &leaves) != 0)
+    {
+        free(leaves.ids);
+        return -1;
     }
 
-    const char *fname = argv[1];
-    const char *target = argv[2];
-    FILE *f = fopen(fname, "rb");
-    if (!f)
+    memset(&scan, 0, sizeof(scan));
+    scan.opts = opts;
+    scan.page_size = db->page_size;
+    scan.usable_size = db->usable_size;
+    scan.lo = lo;
+    scan.hi = hi;
+    scan.query = query;
+    scan.leaves = &leaves;
+    scan.ranges = calloc(n, sizeof(struct steal_range));
+    scan.slots = calloc(leaves.count + 1, sizeof(struct leaf_output));
+    workers = calloc(n, sizeof(struct scan_worker));
+
+    if (!scan.ranges || !scan.slots || !workers)
     {
-        perror("open");
-        return 1;
+        fprintf(stderr, "oom\n");
+        free(scan.ranges);
+        free(scan.slots);
+        free(workers);
+        free(leaves.ids);
+        return -1;
     }
 
-    fseek(f, 0, SEEK_END); 
-    long flen = ftell(f);
-    fseek(f,0,SEEK_SET);
+    if (opts->verbose)
+        fprintf(stderr, "parallel scan: %zu leaves, %d threads, %s\n", leaves.count, n,
+                opts->unordered ? "unordered" : "ordered");
 
-    unsigned char *buf = malloc(flen);
-    if (!buf)
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.ready, NULL);
+
+    for (int i = 0; i < n; ++i)
     {
-        fclose(f);
-        fprintf(stderr,"oom\n"); return 1;
+        pthread_mutex_init(&scan.ranges[i].lock, NULL);
+        if (opts->unordered)
+        {
+            scan.ranges[i].begin = leaves.count * i / n;
+            scan.ranges[i].end = leaves.count * (i + 1) / n;
+        }
     }
 
-    if (fread(buf, 1, flen, f) != (size_t) flen){
-        perror("read");
-        fclose(f);
-        free(buf);
-        return 1;
+    /* Enough room for every worker to hold a chunk or two. */
+    scan.ahead = SCAN_AHEAD > 2 * n * SCAN_CHUNK ? SCAN_AHEAD : 2 * n * SCAN_CHUNK;
+
+    out_flush(out->ob);
+    fflush(stdout);
+
+    for (; started < n; ++started)
+    {
+        workers[started].scan = &scan;
+        workers[started].id = started;
+
+        if (pthread_create(&workers[started].thread, NULL, scan_worker_main, &workers[started]) != 0)
+        {
+            fprintf(stderr, "cannot start scan thread\n");
+            scan_fail(&scan);
+            break;
+        }
     }
-    fclose(f);
 
-    if (flen < 100)
+    for (size_t k = 0; !opts->unordered && k < leaves.count; ++k)
     {
-        fprintf(stderr, "file too small\n");
-        free(buf);
-        return 1;
+        pthread_mutex_lock(&scan.lock);
+        while (!scan.slots[k].done && !scan.failed)
+            pthread_cond_wait(&scan.ready, &scan.lock);
+        int done = scan.slots[k].done;
+        pthread_mutex_unlock(&scan.lock);
+
+        if (!done)
+            break;
+
+        out_write(out->ob, scan.slots[k].data, scan.slots[k].len);
+        out_row_done(out->ob);
+        free(scan.slots[k].data);
+        scan.slots[k].data = NULL;
+
+        pthread_mutex_lock(&scan.lock);
+        scan.merged = k + 1;
+        pthread_cond_broadcast(&scan.ready);
+        pthread_mutex_unlock(&scan.lock);
     }
 
-    if (memcmp(buf, "SQLite format 3\0", 16) != 0)
+    for (int i = 0; i < started; ++i)
+        pthread_join(workers[i].thread, NULL);
+
+    out->rows += scan.rows;
+    db->pager->hits += scan.hits;
+    db->pager->misses += scan.misses;
+
+    for (size_t k = 0; k < leaves.count; ++k)
+        free(scan.slots[k].data);
+
+    for (int i = 0; i < n; ++i)
+        pthread_mutex_destroy(&scan.ranges[i].lock);
+    pthread_mutex_destroy(&scan.lock);
+    pthread_cond_destroy(&scan.ready);
+
+    free(scan.ranges);
+    free(scan.slots);
+    free(workers);
+    free(leaves.ids);
+    return scan.failed || out->ob->failed ? -1 : 0;
+}
+
+/* Column names for CSV/TSV, or the stream header of the binary format. */
+void write_header(struct row_printer *out, const struct query *q, const struct column_def *cols)
+{
+    struct outbuf *ob = out->ob;
+
+    for (int i = 0; i < q->nselect && out->format != FMT_TEXT; ++i)
     {
-        fprintf(stderr, "not sqlite db\n");
-        free(buf);
-        return 1;
+        const char *name = q->select[i] < 0 ? "rowid" : cols[q->select[i]].name;
+        struct sql_value v = { 3, 0, 0, (const unsigned char *)name, strlen(name) };
+
+        if (out->format == FMT_BINARY)
+        {
+            if (i == 0)
+            {
+                out_str(ob, "SQLCOLS1");
+                out_le32(ob, q->nselect);
+            }
+
+            out_le32(ob, v.len);
+            out_write(ob, name, v.len);
+            out_pad8(ob, 4 + v.len);
+            continue;
+        }
+
+        if (i)
+            out_char(ob, out->format == FMT_CSV ? ',' : '\t');
+        out_field(ob, &v, out->format);
     }
 
-    int page_size = (buf[16] << 8) | buf[17];
+    if (out->format == FMT_CSV || out->format == FMT_TSV)
+        out_char(ob, '\n');
+}
+
+/*
+ * Runs --select/--where over the table. A --rowid-file list is looked up
+ * one rowid at a time; otherwise rowid predicates narrow [lo, hi] for the
+ * b-tree walk; otherwise an equality on the leading column of a usable
+ * index picks the rows; otherwise the table is scanned. Every predicate is
+ * still checked on each row the plan produces.
+ */
+int run_query(struct db *db, const struct master_lookup *lookup, char **wheres, int nwheres, char *select,
+              int64_t lo, int64_t hi, const struct id_list *rowids, const struct scan_options *opts,
+              struct row_printer *out)
+{
+    struct column_def *cols;
+    int ncols = table_columns(lookup->sql, &cols);
+    struct query q = { NULL, NULL, -1, -1, NULL, 0, NULL, 0, NULL, 0, out };
+    const struct predicate *indexed = NULL;
+    const struct index_info *index = NULL;
+    int rc = -1;
 
-    if (page_size == 1)
-        page_size = 65536;
+    if (ncols < 0)
+        ncols = 0;
 
-    int encoding = (buf[56] << 24) | (buf[57] << 16) | (buf[58] << 8) | buf[59];
+    q.cols = cols;
+    for (int i = 0; i < ncols; ++i)
+        if (cols[i].rowid_alias)
+            q.rowid_alias = i;
 
-    (void)encoding;
+    q.slot = malloc((ncols + 1) * sizeof(int));
+    q.preds = malloc((nwheres + 1) * sizeof(struct predicate));
+    q.select = malloc((strlen(select ? select : "") / 2 + 1) * sizeof(int));
 
-    if (flen < page_size)
+    if (!q.slot || !q.preds || !q.select)
     {
-        fprintf(stderr, "file too small for one page\n");
-        free(buf);
-        return 1;
+        fprintf(stderr, "oom\n");
+        goto done;
     }
 
-    unsigned char *page1 = buf;
-    unsigned char *bthead = page1 + 100;
-    unsigned char ptype = bthead[0];
+    for (int i = 0; i < ncols; ++i)
+        q.slot[i] = -1;
+
+    for (int i = 0; i < nwheres; ++i)
+    {
+        struct predicate *p = &q.preds[q.npreds++];
+        char *name, *value;
+
+        if (parse_predicate(wheres[i], &name, &p->op, &value) != 0)
+        {
+            fprintf(stderr, "bad predicate: %s\n", wheres[i]);
+            goto done;
+        }
+
+        if ((p->column = find_column(cols, ncols, name)) == -2)
+            goto done;
 
-    if (ptype != 0x0D)
-        fprintf(stderr, "page1 not table leaf (0x0D)\n");
+        int is_rowid = p->column < 0 || p->column == q.rowid_alias;
+
+        if (value)
+            parse_literal(value, is_rowid ? AFF_INTEGER : cols[p->column].affinity, &p->key);
+
+        query_need(&q, p->column);
+
+        if (is_rowid && value && p->key.kind == 1)
+        {
+            int64_t k = p->key.i;
 
-    int cell_count = (bthead[3] << 8) | bthead[4];
-    int cellptrs = 100 + 8;
+            if ((p->op == OP_EQ || p->op == OP_GE) && k > lo)
+                lo = k;
+            if ((p->op == OP_EQ || p->op == OP_LE) && k < hi)
+                hi = k;
+            if (p->op == OP_GT && k != INT64_MAX && k + 1 > lo)
+                lo = k + 1;
+            if (p->op == OP_LT && k != INT64_MIN && k - 1 < hi)
+                hi = k - 1;
+        }
+    }
 
-    for (int i = 0; i < cell_count; ++i)
+    for (char *tok = select ? strtok(select, ",") : NULL; tok; tok = strtok(NULL, ","))
     {
-        int ptr = (page1[cellptrs + i * 2] << 8) | page1[cellptrs + i * 2 + 1];
+        char *name = (char *)skip_space(tok);
+        char *end = name + strlen(name);
+        int col;
 
-        if (ptr <= 0 || ptr >= page_size)
-            continue;
+        while (end > name && isspace((unsigned char)end[-1]))
+            *--end = '\0';
 
-        unsigned char *cell = page1 + ptr;
-        int l1;
-        uint64_t payload = decode_varint(cell, &l1);
-        unsigned char *p = cell + l1;
-        int l2;
-        decode_varint(p, &l2);
-        unsigned char *payloaddata = p + l2;
-
-        int rec_total = (int)payload;
-        unsigned char *record = malloc(rec_total);
-        if (!record)
-            continue;
+        if ((col = find_column(cols, ncols, name)) == -2)
+            goto done;
 
-        memcpy(record, payloaddata, rec_total);
+        q.select[q.nselect++] = col;
+        query_need(&q, col);
+    }
+
+    if (q.nselect == 0 && opts->format != FMT_TEXT)
+    {
+        int *all = realloc(q.select, (ncols + 1) * sizeof(int));
 
-        int tmp_hlen;
-        uint64_t hsz2 = decode_varint(record, &tmp_hlen);
-        int hdrpos = tmp_hlen;
-        int ncols = 0;
-        uint64_t serials[16];
+        if (!all || ncols == 0)
+        {
+            fprintf(stderr, ncols ? "oom\n" : "cannot read the column list of %s\n", lookup->target);
+            free(all);
+            q.select = NULL;
+            goto done;
+        }
 
-        while (hdrpos < (int)hsz2 && ncols < 16)
+        q.select = all;
+        for (int i = 0; i < ncols; ++i)
         {
-            int stlen;
-            serials[ncols] = decode_varint(record + hdrpos, &stlen);
-            hdrpos += stlen;
-            ++ncols;
+            q.select[q.nselect++] = i;
+            query_need(&q, i);
         }
+    }
+
+    q.values = calloc(q.nvalues + 1, sizeof(struct column_value));
+    if (!q.values)
+    {
+        fprintf(stderr, "oom\n");
+        goto done;
+    }
+
+    if (opts->format == FMT_BINARY && batch_init(&out->batch, q.nselect) != 0)
+        goto done;
 
-        int bodypos = hsz2;
+    write_header(out, &q, cols);
 
-        char typebuf[128] = {0};
-        char namebuf[128] = {0};
-        char tblbuf[128] = {0};
-        uint64_t rootpage = 0;
-        char sqlbuf[512] = {0};
+    if (!rowids && lo == INT64_MIN && hi == INT64_MAX)
+    {
+        char first[128];
 
-        for (int c = 0; c < ncols; ++c)
+        for (int i = 0; i < q.npreds && !index; ++i)
         {
-            uint64_t st = serials[c];
+            const struct predicate *p = &q.preds[i];
+
+            if (p->op != OP_EQ || p->column < 0)
+                continue;
 
-            if (st == 0) { /* NULL */ }
-            else if (st >= 13 && (st % 2) == 1)
+            for (int j = 0; j < lookup->nindexes && !index; ++j)
             {
-                int tlen = (st - 13) / 2;
+                int usable = index_first_column(lookup->indexes[j].sql, first, sizeof(first));
 
-                if (bodypos + tlen <= rec_total)
+                /* A key order other than BINARY cannot be binary-searched here. */
+                if ((usable == 2 || (usable == 1 && cols[p->column].binary)) &&
+                    strcasecmp(first, cols[p->column].name) == 0)
                 {
-                    if (c == 0)
-                        memcpy(typebuf, record + bodypos, tlen);
-                    else if (c == 1)
-                        memcpy(namebuf, record + bodypos, tlen);
-                    else if (c == 2)
-                        memcpy(tblbuf, record + bodypos, tlen);
-                    else if (c == 4)
-                        memcpy(sqlbuf, record + bodypos, tlen);
+                    index = &lookup->indexes[j];
+                    indexed = p;
                 }
-
-                bodypos += tlen;
             }
-            else if (st >= 1 && st <= 6)
-            {
-                int sz = (st == 1 ? 1 : st == 2 ? 2 : st == 3 ? 3 : st == 4 ? 4 : st == 5 ? 6 : 8);
-                int64_t v = read_be_signed(record + bodypos, sz);
+        }
+    }
 
-                if (c == 3)
-                    rootpage = (uint64_t)v;
+    if (rowids)
+    {
+        if (opts->verbose)
+            fprintf(stderr, "plan: %zu rowid lookups\n", rowids->count);
 
-                bodypos += sz;
-            }
+        rc = 0;
+        for (size_t i = 0; rc == 0 && i < rowids->count; ++i)
+            if (rowids->ids[i] >= lo && rowids->ids[i] <= hi)
+                rc = scan_rowids(db, lookup->rootpage, rowids->ids[i], rowids->ids[i], query_row, &q);
+    }
+    else if (index)
+    {
+        struct id_list found = { NULL, 0, 0 };
+
+        if (opts->verbose)
+            fprintf(stderr, "plan: index %s\n", index->name);
+
+        rc = scan_index(db, index->rootpage, &indexed->key, &found);
+
+        for (size_t i = 0; rc == 0 && i < found.count; ++i)
+            rc = scan_rowids(db, lookup->rootpage, found.ids[i], found.ids[i], query_row, &q);
+
+        free(found.ids);
+    }
+    else
+    {
+        if (opts->verbose && (lo != INT64_MIN || hi != INT64_MAX))
+            fprintf(stderr, "plan: rowid range %lld:%lld\n", (long long)lo, (long long)hi);
+        else if (opts->verbose)
+            fprintf(stderr, "plan: full scan\n");
+
+        if (lo > hi)
+            rc = 0;
+        else if (opts->threads > 1)
+            rc = parallel_scan(db, opts, lookup->rootpage, lo, hi, &q, out);
+        else
+            rc = scan_rowids(db, lookup->rootpage, lo, hi, query_row, &q);
+    }
+
+done:
+    free(q.values);
+    free(q.select);
+    free(q.preds);
+    free(q.slot);
+    free(cols);
+    return rc;
+}
+
+/* Rowids for --rowid-file, one decimal number per line ("-" is stdin). */
+int read_rowids(const char *path, struct id_list *ids)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char line[64], *end;
+    int rc = 0;
+
+    if (!f)
+    {
+        perror("open rowid file");
+        return -1;
+    }
+
+    while (rc == 0 && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!*line)
+            continue;
+
+        int64_t id = strtoll(line, &end, 10);
+
+        if (*end)
+        {
+            fprintf(stderr, "bad rowid: %s\n", line);
+            rc = -1;
         }
+        else
+            rc = id_push(ids, id);
+    }
 
-        if (strcmp(namebuf, target) == 0)
+    if (f != stdin)
+        fclose(f);
+    return rc;
+}
+
+uint64_t parse_size(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (*end == 'K' || *end == 'k')
+        v *= 1 << 10;
+    else if (*end == 'M' || *end == 'm')
+        v *= 1 << 20;
+    else if (*end == 'G' || *end == 'g')
+        v *= 1 << 30;
+
+    return (uint64_t)v;
+}
+
+int main(int argc, char **argv)
+{
+    struct scan_options opts = { NULL, 8 << 20, 0, 0, 1, 0, FMT_TEXT };
+    int point = 0, bad = 0, c;
+    int64_t lo = INT64_MIN, hi = INT64_MAX;
+    char *end, *select = NULL;
+    const char *rowid_file = NULL;
+    char *wheres[argc];
+    int nwheres = 0;
+
+    static const struct option long_opts[] = {
+        { "rowid", required_argument, NULL, 'r' },
+        { "rowid-range", required_argument, NULL, 'R' },
+        { "rowid-file", required_argument, NULL, 'F' },
+        { "where", required_argument, NULL, 'w' },
+        { "select", required_argument, NULL, 's' },
+        { "threads", required_argument, NULL, 'j' },
+        { "unordered", no_argument, NULL, 'u' },
+        { "format", required_argument, NULL, 'f' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while (!bad && (c = getopt_long(argc, argv, "c:f:j:muv", long_opts, NULL)) != -1)
+    {
+        switch (c)
         {
-            printf("Found table %s at root page %llu\n", target, (unsigned long long)rootpage);
+            case 'r':
+                lo = hi = strtoll(optarg, &end, 10);
+                point = 1;
+                if (*end)
+                    bad = 1;
+                break;
+            case 'R':
+                lo = strtoll(optarg, &end, 10);
+                if (*end != ':')
+                {
+                    bad = 1;
+                    break;
+                }
+                hi = strtoll(end + 1, &end, 10);
+                if (*end)
+                    bad = 1;
+                break;
+            case 'F':
+                rowid_file = optarg;
+                break;
+            case 'w':
+                wheres[nwheres++] = optarg;
+                break;
+            case 's':
+                select = optarg;
+                break;
+            case 'c':
+                opts.cache_bytes = parse_size(optarg);
+                break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0)
+                    opts.format = FMT_TEXT;
+                else if (strcmp(optarg, "csv") == 0)
+                    opts.format = FMT_CSV;
+                else if (strcmp(optarg, "tsv") == 0)
+                    opts.format = FMT_TSV;
+                else if (strcmp(optarg, "binary") == 0)
+                    opts.format = FMT_BINARY;
+                else
+                    bad = 1;
+                break;
+            case 'j':
+                opts.threads = atoi(optarg);
+                if (opts.threads < 1)
+                    bad = 1;
+                break;
+            case 'm':
+                opts.use_mmap = 1;
+                break;
+            case 'u':
+                opts.unordered = 1;
+                break;
+            case 'v':
+                opts.verbose = 1;
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
 
-            if (!rootpage)
-            {
-                fprintf(stderr, "rootpage==0\n");
-                free(record);
-                continue;
-            }
+    if (bad || argc - optind < 2){
+        fprintf(stderr, "Usage: %s [-c cache_size] [-m] [-v] [-j threads [-u]] [-f text|csv|tsv|binary]\n"
+                        "          [--rowid N | --rowid-range A:B | --rowid-file FILE]"
+                        " [--select col,...] [--where 'col OP value' ...] <dbfile> <table_name>\n"
+                        "OP is one of = < > <= >=, or 'col IS [NOT] NULL'\n", argv[0]);
+        return 2;
+    }
 
-            if ((uint64_t)page_size * (rootpage - 1) + page_size > (uint64_t)flen)
-            {
-                fprintf(stderr, "file too small for root page\n");
-                free(record);
-                continue;
-            }
+    const char *fname = opts.fname = argv[optind];
+    const char *target = argv[optind + 1];
+    struct pager pager;
 
-            unsigned char *page = buf + (rootpage - 1) * page_size;
-            unsigned char *hdr = page + 0;
-            unsigned char ptype2 = hdr[0];
+    if (pager_open(&pager, fname, opts.cache_bytes, opts.use_mmap) != 0)
+        return 1;
 
-            if (ptype2 != 0x0D)
-                fprintf(stderr, "table root not leaf (type=%02x)\n", ptype2);
+    if (pager.page_count == 0)
+    {
+        fprintf(stderr, "file too small for one page\n");
+        pager_close(&pager);
+        return 1;
+    }
 
-            int cellcnt = (hdr[3] << 8) | hdr[4];
-            int ptrs_off = 8;
+    unsigned char *page1 = pager_get(&pager, 1);
 
-            for (int ci = 0; ci < cellcnt; ++ci)
-            {
-                int cellptr = (page[ptrs_off + ci * 2] << 8) | page[ptrs_off + ci * 2 + 1];
-                unsigned char *cell2 = page + cellptr;
-                int l1;
-                uint64_t payload2 = decode_varint(cell2, &l1);
-                unsigned char *p2 = cell2 + l1;
-                int l2;
-                uint64_t rowid2 = decode_varint(p2, &l2);
-                unsigned char *payloaddata2 = p2 + l2;
-
-                unsigned char *rec2 = malloc(payload2);
-
-                if (!rec2)
-                    continue;
+    if (!page1 || memcmp(page1, "SQLite format 3\0", 16) != 0)
+    {
+        fprintf(stderr, "not sqlite db\n");
+        pager_close(&pager);
+        return 1;
+    }
 
-                memcpy(rec2, payloaddata2, payload2);
-                printf("rowid=%llu: ", (unsigned long long)rowid2);
-                print_record(rec2, payload2);
-                free(rec2);
-            }
+    int page_size = pager.page_size;
+    int reserved = page1[20];
 
-            free(record);
-            break;
-        }
+    pager_unpin(&pager, page1);
+
+    struct db db = { &pager, page_size, page_size - reserved };
+    struct master_lookup lookup = { 0 };
 
-        free(record);
+    lookup.target = target;
+
+    int rc = scan_table(&db, 1, find_table_cell, &lookup);
+
+    if (rc != 0)
+    {
+        free_lookup(&lookup);
+        pager_close(&pager);
+        return 1;
     }
 
-    free(buf);
-    return 0;
+    if (!lookup.found)
+    {
+        fprintf(stderr, "table %s not found\n", target);
+        free_lookup(&lookup);
+        pager_close(&pager);
+        return 1;
+    }
+
+    if (opts.format == FMT_TEXT)
+        printf("Found table %s at root page %llu\n", target, (unsigned long long)lookup.rootpage);
+
+    if (!lookup.rootpage)
+    {
+        fprintf(stderr, "rootpage==0\n");
+        free_lookup(&lookup);
+        pager_close(&pager);
+        return 1;
+    }
+
+    struct outbuf ob = { NULL, 0, 0, stdout, 0 };
+    struct row_printer out = { { NULL, 0 }, 0, &ob, opts.format, { 0, 0, 0, NULL } };
+    struct id_list rowids = { NULL, 0, 0 };
+
+    if (rowid_file && read_rowids(rowid_file, &rowids) != 0)
+        rc = -1;
+    else if (nwheres || select || opts.format != FMT_TEXT)
+        rc = run_query(&db, &lookup, wheres, nwheres, select, lo, hi, rowid_file ? &rowids : NULL, &opts, &out);
+    else if (rowid_file)
+    {
+        for (size_t i = 0; rc == 0 && i < rowids.count; ++i)
+            if (rowids.ids[i] >= lo && rowids.ids[i] <= hi)
+                rc = scan_rowids(&db, lookup.rootpage, rowids.ids[i], rowids.ids[i], print_table_cell, &out);
+    }
+    else if (opts.threads > 1 && lo <= hi)
+        rc = parallel_scan(&db, &opts, lookup.rootpage, lo, hi, NULL, &out);
+    else
+        rc = scan_rowids(&db, lookup.rootpage, lo, hi, print_table_cell, &out);
+
+    finish_rows(&out);
+    out_flush(&ob);
+    if (rc == 0 && ob.failed)
+        rc = 1;
+
+    /* A row that exists but fails --where is simply not printed. */
+    uint64_t found = 0;
+
+    if (rc == 0 && point && out.rows == 0 &&
+        scan_rowids(&db, lookup.rootpage, lo, lo, count_table_cell, &found) == 0 && found == 0)
+    {
+        fprintf(stderr, "rowid %lld not found\n", (long long)lo);
+        rc = 1;
+    }
+
+    if (opts.verbose && !opts.use_mmap)
+        fprintf(stderr, "page cache: %d frames, %llu hits, %llu misses\n",
+                pager.nframes, (unsigned long long)pager.hits, (unsigned long long)pager.misses);
+
+    batch_free(&out.batch);
+    free(rowids.ids);
+    free(ob.data);
+    free(out.scratch.buf);
+    free_lookup(&lookup);
+    pager_close(&pager);
+    return rc != 0;
 }
@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <zlib.h>
 
 
 int encode_varint(uint64_t v, unsigned char *out)
@@ -48,15 +52,929 @@ int write_be16(unsigned char *p, uint16_t v)
     return 2;
 }
 
-int main(int argc, char **argv)
+/* Growable byte buffer used for records, cells and CSV lines. */
+struct bytes
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+};
+
+int bytes_reserve(struct bytes *b, size_t extra)
+{
+    if (b->len + extra <= b->cap)
+        return 0;
+
+    size_t ncap = b->cap ? b->cap : 256;
+    while (ncap < b->len + extra)
+        ncap *= 2;
+
+    unsigned char *nd = realloc(b->data, ncap);
+    if (!nd)
+        return -1;
+
+    b->data = nd;
+    b->cap = ncap;
+    return 0;
+}
+
+int bytes_append(struct bytes *b, const void *p, size_t n)
+{
+    if (bytes_reserve(b, n) != 0)
+        return -1;
+
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    return 0;
+}
+
+int varint_len(uint64_t v)
+{
+    unsigned char tmp[10];
+
+    return encode_varint(v, tmp);
+}
+
+/* Pages are appended in order; page 1 is reserved up front and rewritten last. */
+struct page_file
 {
-    if (argc < 2)
+    FILE *f;
+    int page_size;
+    uint32_t next_pgno;
+};
+
+uint32_t append_page(struct page_file *pf, const unsigned char *page)
+{
+    if (fwrite(page, 1, pf->page_size, pf->f) != (size_t)pf->page_size)
     {
-        fprintf(stderr, "Usage: %s <out.sqlite>\n", argv[0]);
-        return 2;
+        perror("write page");
+        return 0;
+    }
+
+    return pf->next_pgno++;
+}
+
+/*
+ * One b-tree page under construction. Cell bodies grow down from the end of
+ * the page, the cell pointer array grows up behind the header.
+ */
+struct page_builder
+{
+    unsigned char *page;
+    int hdr_off;
+    int hdr_size;
+    int ncells;
+    int content_start;
+    uint64_t last_key;
+    uint32_t right_child;
+};
+
+void builder_reset(struct page_builder *b, int page_size, int hdr_off, unsigned char type)
+{
+    memset(b->page, 0, page_size);
+    b->hdr_off = hdr_off;
+    b->hdr_size = type == 0x05 ? 12 : 8;
+    b->ncells = 0;
+    b->content_start = page_size;
+    b->right_child = 0;
+    b->page[hdr_off] = type;
+}
+
+int builder_used(const struct page_builder *b, int page_size)
+{
+    return b->hdr_off + b->hdr_size + b->ncells * 2 + (page_size - b->content_start);
+}
+
+/* A cell fits if the page stays under the fill limit; an empty page takes any cell that physically fits. */
+int builder_fits(const struct page_builder *b, int page_size, int cell_len, int limit)
+{
+    int after = builder_used(b, page_size) + cell_len + 2;
+
+    return after <= page_size && (b->ncells == 0 || after <= limit);
+}
+
+void builder_add(struct page_builder *b, const unsigned char *cell, int cell_len, uint64_t key)
+{
+    b->content_start -= cell_len;
+    memcpy(b->page + b->content_start, cell, cell_len);
+    write_be16(b->page + b->hdr_off + b->hdr_size + b->ncells * 2, b->content_start);
+    ++b->ncells;
+    b->last_key = key;
+}
+
+/* Takes back the cell added last, cell_len bytes long. */
+void builder_drop_last(struct page_builder *b, int cell_len)
+{
+    --b->ncells;
+    memset(b->page + b->content_start, 0, cell_len);
+    memset(b->page + b->hdr_off + b->hdr_size + b->ncells * 2, 0, 2);
+    b->content_start += cell_len;
+}
+
+void builder_finish(struct page_builder *b)
+{
+    unsigned char *hdr = b->page + b->hdr_off;
+
+    write_be16(hdr + 3, b->ncells);
+    write_be16(hdr + 5, b->content_start);
+
+    if (hdr[0] == 0x05)
+        write_be32(hdr + 8, b->right_child);
+}
+
+/* Same split as the reader: bytes of a table leaf payload kept on the page. */
+uint64_t local_payload_size(int usable_size, uint64_t payload_size)
+{
+    uint64_t x = usable_size - 35;
+    uint64_t m = ((uint64_t)(usable_size - 12) * 32 / 255) - 23;
+    uint64_t k;
+
+    if (payload_size <= x)
+        return payload_size;
+
+    k = m + (payload_size - m) % (usable_size - 4);
+
+    return k <= x ? k : m;
+}
+
+/*
+ * Formats a table leaf cell. The spilled tail of a large payload is written
+ * straight away as a chain of consecutive overflow pages, so the cell can
+ * point at them before its own leaf is flushed.
+ */
+int build_leaf_cell(struct page_file *pf, uint64_t rowid, const struct bytes *record, struct bytes *cell)
+{
+    uint64_t local = local_payload_size(pf->page_size, record->len);
+    unsigned char tmp[16];
+
+    cell->len = 0;
+    if (bytes_append(cell, tmp, encode_varint(record->len, tmp)) != 0 ||
+        bytes_append(cell, tmp, encode_varint(rowid, tmp)) != 0 ||
+        bytes_append(cell, record->data, local) != 0)
+        return -1;
+
+    if (local == record->len)
+        return 0;
+
+    write_be32(tmp, pf->next_pgno);
+    if (bytes_append(cell, tmp, 4) != 0)
+        return -1;
+
+    unsigned char *ovfl = calloc(1, pf->page_size);
+    uint64_t off = local;
+    int chunk_max = pf->page_size - 4;
+
+    if (!ovfl)
+        return -1;
+
+    while (off < record->len)
+    {
+        uint64_t chunk = record->len - off < (uint64_t)chunk_max ? record->len - off : (uint64_t)chunk_max;
+
+        memset(ovfl, 0, pf->page_size);
+        write_be32(ovfl, off + chunk < record->len ? pf->next_pgno + 1 : 0);
+        memcpy(ovfl + 4, record->data + off, chunk);
+
+        if (!append_page(pf, ovfl))
+        {
+            free(ovfl);
+            return -1;
+        }
+
+        off += chunk;
+    }
+
+    free(ovfl);
+    return 0;
+}
+
+/* (page, largest rowid in its subtree) for every page of the level being built. */
+struct level
+{
+    uint32_t *pgno;
+    uint64_t *max_key;
+    size_t n;
+    size_t cap;
+};
+
+int level_push(struct level *lv, uint32_t pgno, uint64_t key)
+{
+    if (lv->n == lv->cap)
+    {
+        size_t ncap = lv->cap ? lv->cap * 2 : 1024;
+        uint32_t *np = realloc(lv->pgno, ncap * sizeof(*np));
+        if (!np)
+            return -1;
+        lv->pgno = np;
+
+        uint64_t *nk = realloc(lv->max_key, ncap * sizeof(*nk));
+        if (!nk)
+            return -1;
+        lv->max_key = nk;
+
+        lv->cap = ncap;
+    }
+
+    lv->pgno[lv->n] = pgno;
+    lv->max_key[lv->n] = key;
+    ++lv->n;
+    return 0;
+}
+
+/*
+ * Builds interior levels over the leaves until one page remains; that page
+ * is the root. Each interior page takes children as cells (left pointer plus
+ * its max rowid) and its final child becomes the right-most pointer. A page
+ * that would leave a single child for the next one gives up its last cell,
+ * since a non-root interior page without cells is malformed.
+ */
+uint32_t build_interior_levels(struct page_file *pf, struct level *lv, int fill_limit)
+{
+    struct page_builder b;
+    unsigned char cell[16];
+
+    b.page = malloc(pf->page_size);
+    if (!b.page)
+        return 0;
+
+    while (lv->n > 1)
+    {
+        struct level up = { NULL, NULL, 0, 0 };
+        size_t i = 0;
+
+        while (i < lv->n)
+        {
+            int clen = 0;
+
+            builder_reset(&b, pf->page_size, 0, 0x05);
+
+            for (; i + 1 < lv->n; ++i)
+            {
+                int len = 4 + encode_varint(lv->max_key[i], cell + 4);
+
+                if (!builder_fits(&b, pf->page_size, len, fill_limit))
+                    break;
+
+                write_be32(cell, lv->pgno[i]);
+                builder_add(&b, cell, len, lv->max_key[i]);
+                clen = len;
+            }
+
+            if (i + 2 == lv->n && b.ncells > 1)
+            {
+                builder_drop_last(&b, clen);
+                --i;
+            }
+
+            /* An interior page needs a right-most child besides its cells. */
+            b.right_child = lv->pgno[i];
+            b.last_key = lv->max_key[i];
+            ++i;
+
+            builder_finish(&b);
+            uint32_t pgno = append_page(pf, b.page);
+            if (!pgno || level_push(&up, pgno, b.last_key) != 0)
+            {
+                free(b.page);
+                return 0;
+            }
+        }
+
+        free(lv->pgno);
+        free(lv->max_key);
+        *lv = up;
+    }
+
+    free(b.page);
+    return lv->pgno[0];
+}
+
+/*
+ * Classifies a CSV field by its spelling: 1 for a canonical integer
+ * (optional '-', no leading zeros, decimal digits), 2 for a decimal real
+ * (digits, '.', digits and/or an exponent), 0 for anything else, so that
+ * zip codes, hex strings and padded values stay text.
+ */
+int numeric_kind(const char *v)
+{
+    const char *p = v;
+    int real = 0;
+
+    if (*p == '-')
+        ++p;
+    if (!isdigit((unsigned char)*p) || (*p == '0' && isdigit((unsigned char)p[1])))
+        return 0;
+    while (isdigit((unsigned char)*p))
+        ++p;
+
+    if (*p == '.')
+    {
+        if (!isdigit((unsigned char)*++p))
+            return 0;
+        while (isdigit((unsigned char)*p))
+            ++p;
+        real = 1;
+    }
+
+    if (*p == 'e' || *p == 'E')
+    {
+        if (*++p == '+' || *p == '-')
+            ++p;
+        if (!isdigit((unsigned char)*p))
+            return 0;
+        while (isdigit((unsigned char)*p))
+            ++p;
+        real = 1;
+    }
+
+    if (*p)
+        return 0;
+
+    /* "-0" would come back as "0". */
+    if (!real && strcmp(v, "-0") == 0)
+        return 0;
+
+    return real ? 2 : 1;
+}
+
+/*
+ * Record body for one CSV row: empty unquoted fields become NULL, unquoted
+ * fields that numeric_kind accepts and that fit are stored as integers or
+ * reals, the rest as UTF-8 text.
+ */
+int build_record(char **fields, const int *quoted, int nfields, int ncols, struct bytes *hdr, struct bytes *body, struct bytes *record)
+{
+    unsigned char tmp[16];
+
+    hdr->len = 0;
+    body->len = 0;
+
+    for (int c = 0; c < ncols; ++c)
+    {
+        const char *v = c < nfields ? fields[c] : "";
+        size_t vlen = strlen(v);
+        uint64_t st;
+
+        if (vlen == 0 && !(c < nfields && quoted[c]))
+            st = 0;
+        else
+        {
+            int kind = quoted[c] ? 0 : numeric_kind(v);
+            long long iv = 0;
+            double dv = 0;
+
+            errno = 0;
+            if (kind == 1)
+                iv = strtoll(v, NULL, 10);
+            else if (kind == 2)
+                dv = strtod(v, NULL);
+            if (errno)
+                kind = 0;
+
+            if (kind == 1)
+            {
+                int sz;
+
+                if (iv >= -128 && iv <= 127)
+                    st = 1, sz = 1;
+                else if (iv >= -32768 && iv <= 32767)
+                    st = 2, sz = 2;
+                else if (iv >= -8388608 && iv <= 8388607)
+                    st = 3, sz = 3;
+                else if (iv >= INT32_MIN && iv <= INT32_MAX)
+                    st = 4, sz = 4;
+                else if (iv >= -140737488355328LL && iv <= 140737488355327LL)
+                    st = 5, sz = 6;
+                else
+                    st = 6, sz = 8;
+
+                for (int i = sz - 1; i >= 0; --i)
+                    tmp[sz - 1 - i] = (unsigned char)((uint64_t)iv >> (8 * i));
+
+                if (bytes_append(body, tmp, sz) != 0)
+                    return -1;
+            }
+            else if (kind == 2)
+            {
+                uint64_t bits;
+
+                memcpy(&bits, &dv, 8);
+                for (int i = 0; i < 8; ++i)
+                    tmp[i] = (unsigned char)(bits >> (56 - 8 * i));
+
+                st = 7;
+                if (bytes_append(body, tmp, 8) != 0)
+                    return -1;
+            }
+            else
+            {
+                st = 13 + 2 * (uint64_t)vlen;
+                if (bytes_append(body, v, vlen) != 0)
+                    return -1;
+            }
+        }
+
+        if (bytes_append(hdr, tmp, encode_varint(st, tmp)) != 0)
+            return -1;
+    }
+
+    /* The header size varint counts itself. */
+    int hlen = hdr->len + 1;
+    while (varint_len(hlen) + hdr->len != (size_t)hlen)
+        hlen = hdr->len + varint_len(hlen);
+
+    record->len = 0;
+    if (bytes_append(record, tmp, encode_varint(hlen, tmp)) != 0 ||
+        bytes_append(record, hdr->data, hdr->len) != 0 ||
+        bytes_append(record, body->data, body->len) != 0)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Splits one CSV/TSV record into fields in place. Outside TSV a quoted field
+ * may span several physical lines; they are pulled from f as needed, and
+ * *lineno counts every line read. Returns the field count, 0 at end of
+ * input, -1 on error.
+ */
+int read_csv_row(FILE *f, char sep, struct bytes *line, char ***fields, int **quoted, int *fcap, uint64_t *lineno)
+{
+    char *buf = NULL;
+    size_t bufcap = 0;
+    ssize_t n;
+    int inq = 0;
+
+    line->len = 0;
+
+    do
+    {
+        if ((n = getline(&buf, &bufcap, f)) < 0)
+            break;
+        ++*lineno;
+        if (bytes_append(line, buf, n) != 0)
+        {
+            free(buf);
+            return -1;
+        }
+
+        /* Quote parity carries over, so only the new line is scanned. */
+        for (size_t i = line->len - n; sep != '\t' && i < line->len; ++i)
+            if (line->data[i] == '"')
+                inq = !inq;
+    } while (inq);
+
+    free(buf);
+
+    if (line->len == 0)
+        return 0;
+
+    while (line->len && (line->data[line->len - 1] == '\n' || line->data[line->len - 1] == '\r'))
+        --line->len;
+    if (bytes_append(line, "", 1) != 0)
+        return -1;
+
+    char *p = (char *)line->data;
+    char *w = p;
+    int nf = 0;
+
+    for (;;)
+    {
+        if (nf == *fcap)
+        {
+            int ncap = *fcap ? *fcap * 2 : 16;
+            char **nfl = realloc(*fields, ncap * sizeof(char *));
+            int *nq = realloc(*quoted, ncap * sizeof(int));
+
+            if (nfl)
+                *fields = nfl;
+            if (nq)
+                *quoted = nq;
+            if (!nfl || !nq)
+                return -1;
+
+            *fcap = ncap;
+        }
+
+        (*fields)[nf] = w;
+        (*quoted)[nf] = *p == '"' && sep != '\t';
+
+        if ((*quoted)[nf])
+        {
+            ++p;
+            for (;;)
+            {
+                if (*p == '"' && p[1] == '"')
+                {
+                    *w++ = '"';
+                    p += 2;
+                }
+                else if (*p == '"' || *p == '\0')
+                {
+                    if (*p)
+                        ++p;
+                    break;
+                }
+                else
+                    *w++ = *p++;
+            }
+
+            while (*p && *p != sep)
+                ++p;
+        }
+        else
+        {
+            while (*p && *p != sep)
+                *w++ = *p++;
+        }
+
+        ++nf;
+
+        if (*p == sep)
+        {
+            ++p;
+            *w++ = '\0';
+            continue;
+        }
+
+        *w = '\0';
+        break;
+    }
+
+    return nf;
+}
+
+void append_quoted_ident(struct bytes *sql, const char *name)
+{
+    bytes_append(sql, "\"", 1);
+    for (const char *p = name; *p; ++p)
+    {
+        bytes_append(sql, p, 1);
+        if (*p == '"')
+            bytes_append(sql, "\"", 1);
+    }
+    bytes_append(sql, "\"", 1);
+}
+
+/*
+ * Compressed container read by sqlite_reader: a 24-byte header ("SQLZPG01",
+ * then big-endian u32 page size, page count, pages per group and codec)
+ * followed by ngroups + 1 big-endian u64 file offsets, then the groups.
+ * Each group of pages is deflated with zlib, or stored raw when that is not
+ * smaller; the reader tells the two apart by the group's length.
+ */
+#define ZPAGE_MAGIC "SQLZPG01"
+#define ZPAGE_HEADER 24
+#define ZPAGE_CODEC_ZLIB 1
+
+int write_be64(unsigned char *p, uint64_t v)
+{
+    write_be32(p, (uint32_t)(v >> 32));
+    write_be32(p + 4, (uint32_t)v);
+
+    return 8;
+}
+
+/* Copies page_count pages of raw, from its start, into a container at fname. */
+int compress_pages(FILE *raw, int page_size, uint32_t page_count, uint32_t group, const char *fname)
+{
+    uint64_t ngroups = ((uint64_t)page_count + group - 1) / group;
+    uLong gbytes = (uLong)group * page_size;
+    unsigned char hdr[ZPAGE_HEADER];
+    unsigned char *table = calloc(ngroups + 1, 8);
+    unsigned char *in = malloc(gbytes);
+    unsigned char *zout = malloc(compressBound(gbytes));
+    uint64_t offset = ZPAGE_HEADER + (ngroups + 1) * 8, raw_total = (uint64_t)page_count * page_size;
+    FILE *out = NULL;
+    int rc = 1;
+
+    if (gbytes > (64 << 20))
+    {
+        fprintf(stderr, "page groups are limited to 64M\n");
+        goto done;
+    }
+
+    if (!table || !in || !zout)
+    {
+        fprintf(stderr, "oom\n");
+        goto done;
+    }
+
+    out = fopen(fname, "wb");
+    if (!out)
+    {
+        perror("open");
+        goto done;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    memcpy(hdr, ZPAGE_MAGIC, 8);
+    write_be32(hdr + 8, page_size);
+    write_be32(hdr + 12, page_count);
+    write_be32(hdr + 16, group);
+    write_be32(hdr + 20, ZPAGE_CODEC_ZLIB);
+
+    /* The offset table is written as zeros first and filled in at the end. */
+    if (fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr) || fwrite(table, 8, ngroups + 1, out) != ngroups + 1 ||
+        fseek(raw, 0, SEEK_SET) != 0)
+    {
+        perror("write header");
+        goto done;
+    }
+
+    for (uint64_t g = 0; g < ngroups; ++g)
+    {
+        uint32_t npages = page_count - g * group < group ? page_count - g * group : group;
+        uLong len = (uLong)npages * page_size;
+        uLongf zlen = compressBound(len);
+        const unsigned char *data = zout;
+
+        if (fread(in, 1, len, raw) != len)
+        {
+            fprintf(stderr, "short read at page group %llu\n", (unsigned long long)g);
+            goto done;
+        }
+
+        if (compress2(zout, &zlen, in, len, Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            fprintf(stderr, "compress failed at page group %llu\n", (unsigned long long)g);
+            goto done;
+        }
+
+        if (zlen >= len)
+        {
+            data = in;
+            zlen = len;
+        }
+
+        write_be64(table + g * 8, offset);
+
+        if (fwrite(data, 1, zlen, out) != zlen)
+        {
+            perror("write group");
+            goto done;
+        }
+
+        offset += zlen;
+    }
+
+    write_be64(table + ngroups * 8, offset);
+
+    if (fseek(out, ZPAGE_HEADER, SEEK_SET) != 0 || fwrite(table, 8, ngroups + 1, out) != ngroups + 1)
+    {
+        perror("write offset table");
+        goto done;
+    }
+
+    printf("Compressed %u pages into %s: %llu -> %llu bytes (%.2fx, %u pages per group)\n", page_count, fname,
+           (unsigned long long)raw_total, (unsigned long long)offset, offset ? (double)raw_total / offset : 0.0, group);
+    rc = 0;
+
+done:
+    if (out && fclose(out) != 0 && rc == 0)
+    {
+        perror("close");
+        rc = 1;
+    }
+    free(table);
+    free(in);
+    free(zout);
+    return rc;
+}
+
+/* Wraps an existing database file in the compressed container. */
+int compress_db(const char *src, const char *fname, uint32_t group)
+{
+    unsigned char hdr[100];
+    FILE *raw = fopen(src, "rb");
+    int rc;
+
+    if (!raw)
+    {
+        perror("open");
+        return 1;
+    }
+
+    if (fread(hdr, 1, sizeof(hdr), raw) != sizeof(hdr) || memcmp(hdr, "SQLite format 3\0", 16) != 0)
+    {
+        fprintf(stderr, "%s is not an sqlite database\n", src);
+        fclose(raw);
+        return 1;
     }
 
-    const char *fname = argv[1];
+    int page_size = (hdr[16] << 8) | hdr[17];
+
+    if (page_size == 1)
+        page_size = 65536;
+
+    fseek(raw, 0, SEEK_END);
+    long flen = ftell(raw);
+
+    rc = compress_pages(raw, page_size, flen / page_size, group, fname);
+    fclose(raw);
+    return rc;
+}
+
+struct load_options
+{
+    const char *input;
+    const char *table;
+    int page_size;
+    double fill;
+    char sep;
+    uint32_t group;
+};
+
+/*
+ * Streams rows from a CSV/TSV file into a fresh database. Leaves are packed
+ * to the fill factor and written as they fill up, interior levels are built
+ * bottom-up from the list of leaf pages, and page 1 with the schema row is
+ * written last once the root page number is known.
+ */
+int bulk_load(const char *fname, const struct load_options *opt)
+{
+    FILE *in = fopen(opt->input, "rb");
+    if (!in)
+    {
+        perror("open input");
+        return 1;
+    }
+
+    /* With -z the plain file is built in a temporary and wrapped at the end. */
+    FILE *out = opt->group ? tmpfile() : fopen(fname, "wb+");
+    if (!out)
+    {
+        perror("open");
+        fclose(in);
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    const int page_size = opt->page_size;
+    const int fill_limit = (int)(page_size * opt->fill);
+    struct page_file pf = { out, page_size, 1 };
+    struct page_builder leaf;
+    struct level lv = { NULL, NULL, 0, 0 };
+    struct bytes line = { 0 }, hdr = { 0 }, body = { 0 }, record = { 0 }, cell = { 0 }, sql = { 0 };
+    char **fields = NULL;
+    int *quoted = NULL;
+    int fcap = 0, ncols, nf, rc = 1;
+    uint64_t rowid = 0, lineno = 0, first_line;
+
+    leaf.page = calloc(1, page_size);
+    if (!leaf.page)
+        goto done;
+
+    /* Placeholder for page 1. */
+    if (!append_page(&pf, leaf.page))
+        goto done;
+
+    ncols = read_csv_row(in, opt->sep, &line, &fields, &quoted, &fcap, &lineno);
+    if (ncols <= 0)
+    {
+        fprintf(stderr, "input has no header row\n");
+        goto done;
+    }
+
+    bytes_append(&sql, "CREATE TABLE ", 13);
+    append_quoted_ident(&sql, opt->table);
+    bytes_append(&sql, "(", 1);
+    for (int c = 0; c < ncols; ++c)
+    {
+        const char *name = fields[c];
+
+        /* Drop a UTF-8 byte order mark in front of the first column name. */
+        if (c == 0 && memcmp(name, "\xEF\xBB\xBF", 3) == 0)
+            name += 3;
+        if (c)
+            bytes_append(&sql, ", ", 2);
+        append_quoted_ident(&sql, name);
+    }
+    bytes_append(&sql, ")", 2);
+
+    builder_reset(&leaf, page_size, 0, 0x0D);
+
+    while (first_line = lineno + 1, (nf = read_csv_row(in, opt->sep, &line, &fields, &quoted, &fcap, &lineno)) != 0)
+    {
+        if (nf > ncols)
+        {
+            fprintf(stderr, "line %llu: %d fields, but the header has %d\n", (unsigned long long)first_line, nf, ncols);
+            goto done;
+        }
+
+        if (nf < 0 || build_record(fields, quoted, nf, ncols, &hdr, &body, &record) != 0)
+        {
+            fprintf(stderr, "failed to encode row %llu\n", (unsigned long long)rowid + 1);
+            goto done;
+        }
+
+        ++rowid;
+
+        int need = varint_len(record.len) + varint_len(rowid) + (int)local_payload_size(page_size, record.len);
+        if (local_payload_size(page_size, record.len) < record.len)
+            need += 4;
+
+        if (!builder_fits(&leaf, page_size, need, fill_limit))
+        {
+            builder_finish(&leaf);
+            uint32_t pgno = append_page(&pf, leaf.page);
+            if (!pgno || level_push(&lv, pgno, leaf.last_key) != 0)
+                goto done;
+            builder_reset(&leaf, page_size, 0, 0x0D);
+        }
+
+        if (build_leaf_cell(&pf, rowid, &record, &cell) != 0)
+            goto done;
+        builder_add(&leaf, cell.data, cell.len, rowid);
+    }
+
+    builder_finish(&leaf);
+    uint32_t pgno = append_page(&pf, leaf.page);
+    if (!pgno || level_push(&lv, pgno, leaf.last_key) != 0)
+        goto done;
+
+    uint32_t root = build_interior_levels(&pf, &lv, fill_limit);
+    if (!root)
+        goto done;
+
+    /* sqlite_master row: ('table', name, name, root, sql). */
+    const char *master_fields[5];
+    int master_quoted[5] = { 1, 1, 1, 0, 1 };
+    char rootbuf[16];
+
+    snprintf(rootbuf, sizeof(rootbuf), "%u", root);
+    master_fields[0] = "table";
+    master_fields[1] = opt->table;
+    master_fields[2] = opt->table;
+    master_fields[3] = rootbuf;
+    master_fields[4] = (const char *)sql.data;
+
+    if (build_record((char **)master_fields, master_quoted, 5, 5, &hdr, &body, &record) != 0 ||
+        build_leaf_cell(&pf, 1, &record, &cell) != 0)
+        goto done;
+
+    builder_reset(&leaf, page_size, 100, 0x0D);
+    if (!builder_fits(&leaf, page_size, cell.len, page_size))
+    {
+        fprintf(stderr, "schema row does not fit on page 1, use a larger page size\n");
+        goto done;
+    }
+    builder_add(&leaf, cell.data, cell.len, 1);
+    builder_finish(&leaf);
+
+    unsigned char *page = leaf.page;
+    memcpy(page, "SQLite format 3\0", 16);
+    write_be16(page + 16, page_size == 65536 ? 1 : page_size);
+    page[18] = 1;
+    page[19] = 1;
+    page[20] = 0;
+    page[21] = 64;
+    page[22] = 32;
+    page[23] = 32;
+    write_be32(page + 24, 1);
+    write_be32(page + 28, pf.next_pgno - 1);
+    write_be32(page + 40, 1);
+    write_be32(page + 44, 4);
+    write_be32(page + 56, 1);
+    write_be32(page + 92, 1);
+    write_be32(page + 96, 3045000);
+
+    if (fseek(out, 0, SEEK_SET) != 0 || fwrite(page, 1, page_size, out) != (size_t)page_size)
+    {
+        perror("write page1");
+        goto done;
+    }
+
+    printf("Loaded %llu rows into %s (%u pages of %d bytes, root page %u)\n",
+           (unsigned long long)rowid, fname, pf.next_pgno - 1, page_size, root);
+    rc = 0;
+
+    if (opt->group && (fflush(out) != 0 || compress_pages(out, page_size, pf.next_pgno - 1, opt->group, fname) != 0))
+        rc = 1;
+
+done:
+    if (fclose(out) != 0 && rc == 0)
+    {
+        perror("close");
+        rc = 1;
+    }
+    fclose(in);
+    free(leaf.page);
+    free(lv.pgno);
+    free(lv.max_key);
+    free(line.data);
+    free(hdr.data);
+    free(body.data);
+    free(record.data);
+    free(cell.data);
+    free(sql.data);
+    free(fields);
+    free(quoted);
+    return rc;
+}
+
+int write_demo(const char *fname)
+{
     const int page_size = 1024;
     unsigned char page[1024];
 
@@ -255,3 +1173,82 @@ int main(int argc, char **argv)
 
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    struct load_options opt = { NULL, "mytable", 4096, 1.0, ',', 0 };
+    const char *compress_src = NULL;
+    int bad = 0, c;
+
+    while (!bad && (c = getopt(argc, argv, "i:t:p:f:d:z:C:")) != -1)
+    {
+        switch (c)
+        {
+            case 'z':
+                if (atoi(optarg) < 1)
+                    bad = 1;
+                opt.group = atoi(optarg);
+                break;
+            case 'C':
+                compress_src = optarg;
+                break;
+            case 'i':
+                opt.input = optarg;
+                break;
+            case 't':
+                opt.table = optarg;
+                break;
+            case 'p':
+                opt.page_size = atoi(optarg);
+                break;
+            case 'f':
+                opt.fill = atof(optarg);
+                break;
+            case 'd':
+                opt.sep = strcmp(optarg, "tab") == 0 || strcmp(optarg, "\\t") == 0 ? '\t' : optarg[0];
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+
+    if (bad || optind >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-i rows.csv [-t table] [-p page_size] [-f fill] [-d sep] [-z pages_per_group]] <out.sqlite>\n"
+                        "       %s -C in.sqlite [-z pages_per_group] <out.sqlz>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    const char *fname = argv[optind];
+
+    if (compress_src)
+        return compress_db(compress_src, fname, opt.group ? opt.group : 1);
+
+    if (!opt.input && opt.group)
+    {
+        fprintf(stderr, "-z needs -i or -C\n");
+        return 2;
+    }
+
+    if (!opt.input)
+        return write_demo(fname);
+
+    if (opt.page_size < 512 || opt.page_size > 65536 || (opt.page_size & (opt.page_size - 1)))
+    {
+        fprintf(stderr, "page size must be a power of two between 512 and 65536\n");
+        return 2;
+    }
+
+    if (opt.fill < 0.1 || opt.fill > 1.0)
+    {
+        fprintf(stderr, "fill factor must be in [0.1, 1]\n");
+        return 2;
+    }
+
+    size_t ilen = strlen(opt.input);
+    if (ilen > 4 && strcmp(opt.input + ilen - 4, ".tsv") == 0 && opt.sep == ',')
+        opt.sep = '\t';
+
+    return bulk_load(fname, &opt);
+}
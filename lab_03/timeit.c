@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+
+/*
+ * Runs a command and reports its wall time in seconds and the peak resident
+ * set of it and all the children it waited for, in KB, on stderr:
+ *   timeit ./sqlite_reader db t > /dev/null
+ *   1.234567 10240
+ */
+int main(int argc, char **argv)
+{
+    struct timespec t0, t1;
+    struct rusage ru;
+    int status;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <command> [args...]\n", argv[0]);
+        return 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+
+    if (pid == 0)
+    {
+        execvp(argv[1], argv + 1);
+        perror("exec");
+        _exit(127);
+    }
+
+    if (waitpid(pid, &status, 0) < 0)
+    {
+        perror("wait");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    getrusage(RUSAGE_CHILDREN, &ru);
+
+    fprintf(stderr, "%.6f %ld\n", (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, ru.ru_maxrss);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,43 @@
+#!/usr/bin/env gnuplot
+
+if (!exists("bench_size")) bench_size = "64M"
+
+set terminal pdfcairo size 12,8 enhanced color font 'Arial,12'
+set output 'bench_plots.pdf'
+
+corpora = system("awk -F, 'NR>1 {split($2,p,\".\"); print p[1]}' out/bench.csv | sort -u | tr '\\n' ' '")
+algorithms = "Huffman Huffman-o1 zlib"
+
+series(a, c, filter, cols) = sprintf("< awk -F, -v a=%s -v c=%s '$1==a && %s {split($2,p,\".\"); if (p[1]==c) print %s}' out/bench.csv | sort -n -u", a, c, filter, cols)
+by_size(a, c, col) = series(a, c, "$4==1", "$3, ".col)
+by_threads(a, c, col) = series(a, c, sprintf("$2==c\".%s\"", bench_size), "$4, ".col)
+
+set multiplot layout 2,2 title "Масштабирование Хаффмана (порядок 0 и 1) и zlib на синтетических данных" font 'Arial,16'
+
+set grid
+set key outside right top vertical font ',9'
+set tics font ",10"
+set style data linespoints
+
+set title "Скорость кодирования (1 поток)" font 'Arial,14'
+set xlabel "Размер (байт)" font 'Arial,12'
+set ylabel "МБ/с" font 'Arial,12'
+set logscale x 2
+set format x "2^{%L}"
+plot for [c in corpora] for [a in algorithms] by_size(a, c, "$6") title a." ".c
+
+set title "Коэффициент сжатия" font 'Arial,14'
+set ylabel "Коэффициент сжатия" font 'Arial,12'
+plot for [c in corpora] for [a in algorithms] by_size(a, c, "$5") title a." ".c
+
+set title "Скорость кодирования (".bench_size.")" font 'Arial,14'
+set xlabel "Потоки" font 'Arial,12'
+set ylabel "МБ/с" font 'Arial,12'
+set format x "%g"
+plot for [c in corpora] for [a in algorithms] by_threads(a, c, "$6") title a." ".c
+
+set title "Скорость декодирования (".bench_size.")" font 'Arial,14'
+plot for [c in corpora] for [a in algorithms] by_threads(a, c, "$7") title a." ".c
+
+unset multiplot
+unset output
@@ -0,0 +1,261 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    uint64_t below(uint64_t n) {
+        return next() % n;
+    }
+
+private:
+    uint64_t state;
+};
+
+// Walker alias table: O(1) sampling from a fixed discrete distribution.
+class AliasTable {
+public:
+    explicit AliasTable(const std::vector<double>& probs) : prob(probs.size()), alias(probs.size()) {
+        const size_t n = probs.size();
+        std::vector<double> scaled(n);
+        std::vector<size_t> small, large;
+
+        for (size_t i = 0; i < n; ++i) {
+            scaled[i] = probs[i] * n;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            size_t s = small.back();
+            small.pop_back();
+            size_t l = large.back();
+
+            prob[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        for (size_t i : large)
+            prob[i] = 1.0;
+        for (size_t i : small)
+            prob[i] = 1.0;
+    }
+
+    size_t sample(Random& rng) const {
+        size_t i = rng.below(prob.size());
+        return rng.uniform() < prob[i] ? i : alias[i];
+    }
+
+private:
+    std::vector<double> prob;
+    std::vector<size_t> alias;
+};
+
+struct CorpusParams {
+    uint64_t size = 1 << 20;
+    unsigned alphabet = 256;
+    double skew = 0.0;
+    double entropy = -1.0;
+    double repeat = 0.0;
+    unsigned matchLen = 16;
+    unsigned window = 32768;
+    uint64_t seed = 1;
+};
+
+static std::vector<double> zipf(unsigned alphabet, double skew) {
+    std::vector<double> p(alphabet);
+    double sum = 0.0;
+
+    for (unsigned k = 0; k < alphabet; ++k)
+        sum += p[k] = 1.0 / std::pow(k + 1.0, skew);
+    for (double& v : p)
+        v /= sum;
+
+    return p;
+}
+
+static double entropyBits(const std::vector<double>& p) {
+    double h = 0.0;
+    for (double v : p)
+        if (v > 0)
+            h -= v * std::log2(v);
+    return h;
+}
+
+// Entropy of a Zipf distribution falls monotonically with skew, so bisect for the target.
+static double skewForEntropy(unsigned alphabet, double target) {
+    if (target > std::log2(alphabet) + 1e-9)
+        throw std::runtime_error("Entropy exceeds log2(alphabet)");
+
+    double lo = 0.0, hi = 64.0;
+    for (int i = 0; i < 100; ++i) {
+        double mid = (lo + hi) / 2;
+        if (entropyBits(zipf(alphabet, mid)) > target)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return (lo + hi) / 2;
+}
+
+static unsigned char symbolFor(unsigned rank, unsigned alphabet) {
+    return alphabet <= 95 ? static_cast<unsigned char>(' ' + rank) : static_cast<unsigned char>(rank);
+}
+
+static uint64_t parseSize(const std::string& s) {
+    size_t pos;
+    double v = std::stod(s, &pos);
+    std::string suffix = s.substr(pos);
+    uint64_t mul = 1;
+
+    if (suffix == "K" || suffix == "k")
+        mul = 1ULL << 10;
+    else if (suffix == "M" || suffix == "m")
+        mul = 1ULL << 20;
+    else if (suffix == "G" || suffix == "g")
+        mul = 1ULL << 30;
+    else if (!suffix.empty())
+        throw std::runtime_error("Bad size suffix: " + s);
+
+    return static_cast<uint64_t>(v * mul);
+}
+
+static void generate(const CorpusParams& params, const std::string& outputFile) {
+    if (params.alphabet < 1 || params.alphabet > 256)
+        throw std::runtime_error("Alphabet size must be in [1, 256]");
+    if (params.repeat < 0.0 || params.repeat >= 1.0)
+        throw std::runtime_error("Repeat fraction must be in [0, 1)");
+    if (params.matchLen == 0 || params.window == 0 || (params.window & (params.window - 1)))
+        throw std::runtime_error("Match length must be positive and window a power of two");
+
+    double skew = params.entropy >= 0 ? skewForEntropy(params.alphabet, params.entropy) : params.skew;
+    std::vector<double> probs = zipf(params.alphabet, skew);
+    AliasTable table(probs);
+    Random rng(params.seed);
+
+    std::ofstream outFile(outputFile, std::ios::binary);
+    if (!outFile)
+        throw std::runtime_error("Cannot open output file: " + outputFile);
+
+    // Probability of starting a copy so that on average `repeat` of all bytes come from matches.
+    const double copyProb = params.repeat / (params.repeat + params.matchLen * (1.0 - params.repeat));
+    const size_t mask = params.window - 1;
+    std::vector<unsigned char> history(params.window);
+    std::vector<unsigned char> block;
+    block.reserve(1 << 20);
+
+    uint64_t written = 0;
+    while (written < params.size) {
+        if (written > 0 && rng.uniform() < copyProb) {
+            uint64_t maxDist = std::min<uint64_t>(written, params.window);
+            uint64_t dist = 1 + rng.below(maxDist);
+            unsigned len = 1 + rng.below(2 * params.matchLen - 1);
+
+            for (unsigned i = 0; i < len && written < params.size; ++i, ++written) {
+                unsigned char c = history[(written - dist) & mask];
+                history[written & mask] = c;
+                block.push_back(c);
+            }
+        } else {
+            unsigned char c = symbolFor(table.sample(rng), params.alphabet);
+            history[written & mask] = c;
+            block.push_back(c);
+            ++written;
+        }
+
+        if (block.size() >= (1 << 20)) {
+            outFile.write(reinterpret_cast<const char*>(block.data()), block.size());
+            block.clear();
+        }
+    }
+
+    outFile.write(reinterpret_cast<const char*>(block.data()), block.size());
+    if (!outFile)
+        throw std::runtime_error("Write failed: " + outputFile);
+
+    std::cout << "[Generated]: " << outputFile << " size=" << params.size << " alphabet=" << params.alphabet
+              << " skew=" << skew << " entropy=" << entropyBits(probs) << " bits/symbol repeat=" << params.repeat << std::endl;
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <output>\n"
+              << "  -s SIZE     output size, K/M/G suffixes allowed (default 1M)\n"
+              << "  -a N        alphabet size, 1..256 (default 256)\n"
+              << "  -z SKEW     Zipf exponent of symbol frequencies (default 0 = uniform)\n"
+              << "  -e BITS     target order-0 entropy in bits/symbol, overrides -z\n"
+              << "  -r FRAC     fraction of bytes copied from earlier data, 0..1 (default 0)\n"
+              << "  -l LEN      mean copy length (default 16)\n"
+              << "  -w BYTES    copy window, power of two (default 32768)\n"
+              << "  -S SEED     random seed (default 1)\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        CorpusParams params;
+        std::string outputFile;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+
+            if (arg.size() >= 2 && arg[0] == '-' && (arg.size() > 2 || i + 1 < argc)) {
+                std::string val = arg.size() > 2 ? arg.substr(2) : argv[++i];
+
+                switch (arg[1]) {
+                    case 's': params.size = parseSize(val); break;
+                    case 'a': params.alphabet = std::stoul(val); break;
+                    case 'z': params.skew = std::stod(val); break;
+                    case 'e': params.entropy = std::stod(val); break;
+                    case 'r': params.repeat = std::stod(val); break;
+                    case 'l': params.matchLen = std::stoul(val); break;
+                    case 'w': params.window = std::stoul(val); break;
+                    case 'S': params.seed = std::stoull(val); break;
+                    default:
+                        usage(argv[0]);
+                        return 2;
+                }
+            } else if (outputFile.empty() && arg[0] != '-') {
+                outputFile = arg;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+
+        if (outputFile.empty()) {
+            usage(argv[0]);
+            return 2;
+        }
+
+        generate(params, outputFile);
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
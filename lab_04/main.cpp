@@ -3,14 +3,215 @@
 #include <vector>
 #include <map>
 #include <queue>
-#include <bitset>
 #include <stdexcept>
 #include <zlib.h>
 #include <chrono>
 #include <iomanip>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <exception>
+
+
+class MemoryTracker {
+public:
+    static void onAlloc(size_t n) {
+        size_t now = currentBytes.fetch_add(n, std::memory_order_relaxed) + n;
+        size_t lim = limitBytes.load(std::memory_order_relaxed);
+
+        if (lim && now > lim) {
+            currentBytes.fetch_sub(n, std::memory_order_relaxed);
+            throw std::bad_alloc();
+        }
+
+        size_t prev = peakBytes.load(std::memory_order_relaxed);
+        while (now > prev && !peakBytes.compare_exchange_weak(prev, now, std::memory_order_relaxed)) {}
+    }
+
+    static void onFree(size_t n) { currentBytes.fetch_sub(n, std::memory_order_relaxed); }
+    static size_t current() { return currentBytes.load(); }
+    static size_t peak() { return peakBytes.load(); }
+    static void resetPeak() { peakBytes.store(currentBytes.load()); }
+    static void setLimit(size_t bytes) { limitBytes.store(bytes); }
+
+    static size_t peakRSS() {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return static_cast<size_t>(ru.ru_maxrss) * 1024;
+    }
+
+private:
+    static std::atomic<size_t> currentBytes;
+    static std::atomic<size_t> peakBytes;
+    static std::atomic<size_t> limitBytes;
+};
+
+std::atomic<size_t> MemoryTracker::currentBytes{0};
+std::atomic<size_t> MemoryTracker::peakBytes{0};
+std::atomic<size_t> MemoryTracker::limitBytes{0};
+
+// Every heap block carries its size in a header so frees can be accounted without malloc_usable_size.
+static constexpr size_t kAllocHeader = alignof(std::max_align_t);
+
+static void* trackedAlloc(size_t n) {
+    MemoryTracker::onAlloc(n);
+    auto* p = static_cast<unsigned char*>(std::malloc(n + kAllocHeader));
+    if (!p) {
+        MemoryTracker::onFree(n);
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(p) = n;
+    return p + kAllocHeader;
+}
+
+static void trackedFree(void* ptr) noexcept {
+    if (!ptr)
+        return;
+    auto* p = static_cast<unsigned char*>(ptr) - kAllocHeader;
+    MemoryTracker::onFree(*reinterpret_cast<size_t*>(p));
+    std::free(p);
+}
+
+void* operator new(size_t n) { return trackedAlloc(n); }
+void* operator new[](size_t n) { return trackedAlloc(n); }
+void operator delete(void* p) noexcept { trackedFree(p); }
+void operator delete[](void* p) noexcept { trackedFree(p); }
+void operator delete(void* p, size_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, size_t) noexcept { trackedFree(p); }
+
+static voidpf zlibAlloc(voidpf, uInt items, uInt size) {
+    try {
+        return trackedAlloc(static_cast<size_t>(items) * size);
+    } catch (const std::bad_alloc&) {
+        return Z_NULL;
+    }
+}
+
+static void zlibFree(voidpf, voidpf ptr) { trackedFree(ptr); }
+
+// Splits a byte budget between worker threads and block size. Each in-flight block costs
+// about four block sizes (input, encoded output, decoded copy and growth slack); a fixed
+// reserve covers stream buffers, zlib state and trees.
+struct MemoryBudget {
+    static constexpr size_t kReserve = 1 << 20;
+    static constexpr size_t kMinBlock = 64 << 10;
+    static constexpr size_t kMaxBlock = 64 << 20;
+    static constexpr size_t kBlockCost = 4;
+
+    size_t bytes;
+    unsigned threads;
+    size_t blockSize;
 
+    static MemoryBudget plan(size_t bytes, unsigned maxThreads) {
+        if (bytes < kReserve + kBlockCost * kMinBlock)
+            throw std::runtime_error("Memory budget too small, need at least " + std::to_string((kReserve + kBlockCost * kMinBlock) >> 10) + " KB");
+
+        size_t usable = bytes - kReserve;
+        unsigned threads = std::max(1u, std::min<unsigned>(maxThreads, usable / (kBlockCost * kMinBlock)));
+        size_t block = std::min(kMaxBlock, usable / (kBlockCost * threads));
+        block -= block % kMinBlock;
+
+        return {bytes, threads, block};
+    }
+
+    size_t streamChunk() const {
+        return std::min<size_t>(blockSize, 1 << 20);
+    }
+};
+
+template <typename Job>
+static void parallelFor(size_t n, Job job) {
+    if (n == 1) {
+        job(0);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(n);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < n; ++i)
+        workers.emplace_back([&, i] {
+            try {
+                job(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    for (auto& w : workers)
+        w.join();
+
+    for (auto& e : errors)
+        if (e)
+            std::rethrow_exception(e);
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out), acc(0), count(0) {}
+
+    void put(uint64_t bits, int len) {
+        while (len > 0) {
+            int take = std::min(len, 56 - count);
+            len -= take;
+            acc = (acc << take) | ((bits >> len) & ((1ULL << take) - 1));
+            count += take;
+
+            while (count >= 8) {
+                count -= 8;
+                out.push_back(static_cast<unsigned char>(acc >> count));
+            }
+        }
+    }
+
+    void flush() {
+        if (count)
+            out.push_back(static_cast<unsigned char>(acc << (8 - count)));
+        count = 0;
+    }
+
+private:
+    std::vector<unsigned char>& out;
+    uint64_t acc;
+    int count;
+};
+
+// MSB-first reader matching BitWriter. Reads past the end yield zero bits; callers check consumed() afterwards.
+class BitReader {
+public:
+    BitReader(const unsigned char* data, size_t size) : p(data), end(data + size), acc(0), count(0), used(0) {}
+
+    void refill() {
+        while (count <= 56) {
+            acc |= static_cast<uint64_t>(p < end ? *p++ : 0) << (56 - count);
+            count += 8;
+        }
+    }
+
+    uint32_t peek(int n) const { return static_cast<uint32_t>(acc >> (64 - n)); }
+    int available() const { return count; }
+
+    void skip(int n) {
+        acc <<= n;
+        count -= n;
+        used += n;
+    }
+
+    size_t consumed() const { return used; }
+
+private:
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t acc;
+    int count;
+    size_t used;
+};
 
 class HuffmanNode {
 public:
@@ -30,8 +231,11 @@ public:
 
 class HuffmanCompression {
 public:
-    static void compress(const std::string& inputFile, const std::string& outputFile);
-    static void decompress(const std::string& inputFile, const std::string& outputFile);
+    static void compress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget);
+    static void decompress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget);
+    static std::vector<unsigned char> encode(const std::vector<unsigned char>& input);
+    static std::vector<unsigned char> decode(const std::vector<unsigned char>& input);
+    static HuffmanNode* buildHuffmanTree(const std::map<unsigned char, int>& freqMap);
 
 private:
     struct Compare {
@@ -40,12 +244,18 @@ private:
         }
     };
 
-    static HuffmanNode* buildHuffmanTree(const std::map<unsigned char, int>& freqMap);
+    struct Code {
+        uint64_t bits;
+        int len;
+    };
+
     static void buildCodes(const HuffmanNode* root, const std::string& str, std::map<unsigned char, std::string>& huffmanCode);
-    static void writeCompressedFile(std::ofstream& outFile, const std::map<unsigned char, std::string>& huffmanCode, const std::string& inputFile);
-    static void writeFrequencyTable(std::ofstream& outFile, const std::map<unsigned char, int>& freqMap);
-    static std::map<unsigned char, int> readFrequencyTable(std::ifstream& inFile);
-    static std::string readEncodedData(std::ifstream& inFile);
+    static void encodeBlock(const unsigned char* data, size_t n, std::vector<unsigned char>& out);
+    static void decodeBlock(const std::vector<unsigned char>& in, size_t& pos, std::vector<unsigned char>& out);
+    static bool readBlock(std::ifstream& inFile, std::vector<unsigned char>& raw, size_t& decodedSize);
+    static void writeEncodedData(std::vector<unsigned char>& out, const std::map<unsigned char, std::string>& huffmanCode, const unsigned char* data, size_t n);
+    static void writeFrequencyTable(std::vector<unsigned char>& out, const std::map<unsigned char, int>& freqMap);
+    static std::map<unsigned char, int> readFrequencyTable(const std::vector<unsigned char>& in, size_t& pos);
 };
 
 HuffmanNode* HuffmanCompression::buildHuffmanTree(const std::map<unsigned char, int>& freqMap) {
@@ -82,141 +292,662 @@ void HuffmanCompression::buildCodes(const HuffmanNode* root, const std::string&
     buildCodes(root->right, str + "1", huffmanCode);
 }
 
-void HuffmanCompression::writeFrequencyTable(std::ofstream& outFile, const std::map<unsigned char, int>& freqMap) {
+template <typename T>
+static void appendRaw(std::vector<unsigned char>& out, const T& value) {
+    const auto* p = reinterpret_cast<const unsigned char*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+static bool readRaw(const std::vector<unsigned char>& in, size_t& pos, T& value) {
+    if (in.size() - pos < sizeof(T))
+        return false;
+
+    std::memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+std::vector<unsigned char> readFile(const std::string& path) {
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile)
+        throw std::runtime_error("Cannot open input file: " + path);
+
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+}
+
+static size_t readChunk(std::ifstream& inFile, std::vector<unsigned char>& buf, size_t maxBytes) {
+    buf.resize(maxBytes);
+    inFile.read(reinterpret_cast<char*>(buf.data()), maxBytes);
+    buf.resize(inFile.gcount());
+    return buf.size();
+}
+
+void HuffmanCompression::writeFrequencyTable(std::vector<unsigned char>& out, const std::map<unsigned char, int>& freqMap) {
     uint32_t size = freqMap.size();
-    outFile.write(reinterpret_cast<char*>(&size), sizeof(size));
+    appendRaw(out, size);
 
     for (const auto& p : freqMap) {
-        outFile.put(p.first);
-        outFile.write(reinterpret_cast<const char*>(&p.second), sizeof(p.second));
+        out.push_back(p.first);
+        appendRaw(out, p.second);
     }
 }
 
-std::map<unsigned char, int> HuffmanCompression::readFrequencyTable(std::ifstream& inFile) {
+std::map<unsigned char, int> HuffmanCompression::readFrequencyTable(const std::vector<unsigned char>& in, size_t& pos) {
     std::map<unsigned char, int> freqMap;
     uint32_t size;
     int freq;
 
-    if (!inFile.read(reinterpret_cast<char*>(&size), sizeof(size)))
-        return {};
+    if (!readRaw(in, pos, size))
+        throw std::runtime_error("Truncated block header");
 
     for (uint32_t i = 0; i < size; ++i) {
-        unsigned char ch = inFile.get();
-        inFile.read(reinterpret_cast<char*>(&freq), sizeof(freq));
+        if (pos >= in.size())
+            throw std::runtime_error("Truncated frequency table");
+        unsigned char ch = in[pos++];
+        if (!readRaw(in, pos, freq))
+            throw std::runtime_error("Truncated frequency table");
         freqMap[ch] = freq;
     }
 
     return freqMap;
 }
 
-void HuffmanCompression::writeCompressedFile(std::ofstream& outFile, const std::map<unsigned char, std::string>& huffmanCode, const std::string& inputFile) {
-    std::ifstream inFile(inputFile, std::ios::binary);
-    if (!inFile)
-        throw std::runtime_error("Cannot open input file for compression");
+void HuffmanCompression::writeEncodedData(std::vector<unsigned char>& out, const std::map<unsigned char, std::string>& huffmanCode, const unsigned char* data, size_t n) {
+    Code codes[256] = {};
+    size_t originalBitLength = 0;
 
-    std::string encodedData;
-    char ch;
-    while (inFile.get(ch))
-        encodedData += huffmanCode.at(ch);
-    inFile.close();
+    for (const auto& p : huffmanCode) {
+        codes[p.first] = {std::stoull(p.second, nullptr, 2), static_cast<int>(p.second.size())};
+    }
+    for (size_t i = 0; i < n; ++i)
+        originalBitLength += codes[data[i]].len;
 
-    const size_t originalBitLength = encodedData.size();
-    while (encodedData.size() % 8)
-        encodedData += '0';
+    appendRaw(out, originalBitLength);
+    out.reserve(out.size() + (originalBitLength + 7) / 8);
 
-    outFile.write(reinterpret_cast<const char*>(&originalBitLength), sizeof(originalBitLength));
+    BitWriter writer(out);
+    for (size_t i = 0; i < n; ++i)
+        writer.put(codes[data[i]].bits, codes[data[i]].len);
+    writer.flush();
+}
 
-    for (size_t i = 0; i < encodedData.size(); i += 8) {
-        std::bitset<8> byte(encodedData.substr(i, 8));
-        outFile.put(static_cast<unsigned char>(byte.to_ulong()));
-    }
+void HuffmanCompression::encodeBlock(const unsigned char* data, size_t n, std::vector<unsigned char>& out) {
+    std::map<unsigned char, int> freqMap;
+    for (size_t i = 0; i < n; ++i)
+        freqMap[data[i]]++;
+
+    if (freqMap.empty())
+        return;
+
+    HuffmanNode* root = buildHuffmanTree(freqMap);
+    std::map<unsigned char, std::string> huffmanCode;
+    buildCodes(root, "", huffmanCode);
+    delete root;
+
+    writeFrequencyTable(out, freqMap);
+    writeEncodedData(out, huffmanCode, data, n);
 }
 
-std::string HuffmanCompression::readEncodedData(std::ifstream& inFile) {
+// A block is self-delimiting: the table gives the symbol count and the bit length gives the payload size.
+void HuffmanCompression::decodeBlock(const std::vector<unsigned char>& in, size_t& pos, std::vector<unsigned char>& out) {
+    std::map<unsigned char, int> freqMap = readFrequencyTable(in, pos);
+    if (freqMap.empty())
+        return;
+
     size_t originalBitLength;
-    inFile.read(reinterpret_cast<char*>(&originalBitLength), sizeof(originalBitLength));
+    if (!readRaw(in, pos, originalBitLength) || (in.size() - pos) * 8 < originalBitLength)
+        throw std::runtime_error("Truncated Huffman stream");
 
-    std::string encodedData;
-    unsigned char byte;
+    size_t symbols = 0;
+    for (const auto& p : freqMap)
+        symbols += p.second;
+    out.reserve(out.size() + symbols);
 
-    while (inFile.read(reinterpret_cast<char*>(&byte), 1)) {
-        std::bitset<8> bits(byte);
-        encodedData += bits.to_string();
+    HuffmanNode* root = buildHuffmanTree(freqMap);
+    if (!root)
+        throw std::runtime_error("Failed to rebuild Huffman tree");
+
+    const unsigned char* bits = in.data() + pos;
+
+    if (!root->left && !root->right)
+        out.insert(out.end(), originalBitLength, root->ch);
+    else {
+        const HuffmanNode* current = root;
+
+        for (size_t i = 0; i < originalBitLength; ++i) {
+            bool bit = (bits[i >> 3] >> (7 - (i & 7))) & 1;
+            current = bit ? current->right : current->left;
+
+            if (!current->left && !current->right) {
+                out.push_back(current->ch);
+                current = root;
+            }
+        }
     }
 
-    encodedData = encodedData.substr(0, originalBitLength);
+    pos += (originalBitLength + 7) / 8;
+    delete root;
+}
+
+bool HuffmanCompression::readBlock(std::ifstream& inFile, std::vector<unsigned char>& raw, size_t& decodedSize) {
+    uint32_t size;
+    raw.clear();
+    if (!inFile.read(reinterpret_cast<char*>(&size), sizeof(size)))
+        return false;
+    if (size > 256)
+        throw std::runtime_error("Corrupt frequency table");
+
+    appendRaw(raw, size);
+    size_t tableBytes = size * (1 + sizeof(int)) + sizeof(size_t);
+    raw.resize(raw.size() + tableBytes);
+    if (!inFile.read(reinterpret_cast<char*>(raw.data() + sizeof(size)), tableBytes))
+        throw std::runtime_error("Truncated Huffman stream");
+
+    size_t pos = 0;
+    decodedSize = 0;
+    for (const auto& p : readFrequencyTable(raw, pos))
+        decodedSize += p.second;
+
+    size_t originalBitLength = 0;
+    readRaw(raw, pos, originalBitLength);
+
+    size_t payload = (originalBitLength + 7) / 8;
+    raw.resize(raw.size() + payload);
+    if (!inFile.read(reinterpret_cast<char*>(raw.data() + pos), payload))
+        throw std::runtime_error("Truncated Huffman stream");
+
+    return true;
+}
+
+std::vector<unsigned char> HuffmanCompression::encode(const std::vector<unsigned char>& input) {
+    std::vector<unsigned char> out;
+    out.reserve(input.size() + input.size() / 8 + 2048);
+    encodeBlock(input.data(), input.size(), out);
+    return out;
+}
+
+std::vector<unsigned char> HuffmanCompression::decode(const std::vector<unsigned char>& input) {
+    std::vector<unsigned char> out;
+    size_t pos = 0;
+
+    while (pos < input.size())
+        decodeBlock(input, pos, out);
 
-    return encodedData;
+    return out;
 }
 
-void HuffmanCompression::compress(const std::string& inputFile, const std::string& outputFile) {
+using BlockEncoder = std::function<void(const unsigned char*, size_t, std::vector<unsigned char>&)>;
+using BlockReader = std::function<bool(std::ifstream&, std::vector<unsigned char>&, size_t&)>;
+using BlockDecoder = std::function<void(const std::vector<unsigned char>&, size_t&, std::vector<unsigned char>&)>;
+
+// Shared streaming driver for block codecs: reads up to `threads` blocks, encodes them in parallel, writes in order.
+static void compressBlocks(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget, const BlockEncoder& encodeBlock) {
     std::ifstream inFile(inputFile, std::ios::binary);
     if (!inFile)
         throw std::runtime_error("Cannot open input file");
 
-    std::map<unsigned char, int> freqMap;
-    unsigned char byte;
-    while (inFile.read(reinterpret_cast<char*>(&byte), 1))
-        freqMap[byte]++;
-    inFile.close();
+    std::ofstream outFile(outputFile, std::ios::binary);
+    if (!outFile)
+        throw std::runtime_error("Cannot open output file");
+
+    inFile.seekg(0, std::ios::end);
+    const size_t fileSize = inFile.tellg();
+    inFile.seekg(0, std::ios::beg);
+    const size_t blockSize = std::max<size_t>(1, std::min(budget.blockSize, (fileSize + budget.threads - 1) / budget.threads));
+
+    std::vector<std::vector<unsigned char>> in(budget.threads), out(budget.threads);
+
+    while (inFile) {
+        size_t n = 0;
+        while (n < budget.threads && readChunk(inFile, in[n], blockSize))
+            ++n;
+        if (!n)
+            break;
+
+        parallelFor(n, [&](size_t i) {
+            out[i].clear();
+            out[i].reserve(in[i].size() + in[i].size() / 8 + 2048);
+            encodeBlock(in[i].data(), in[i].size(), out[i]);
+        });
+
+        for (size_t i = 0; i < n; ++i)
+            outFile.write(reinterpret_cast<const char*>(out[i].data()), out[i].size());
+    }
+}
+
+static void decompressBlocks(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget, const BlockReader& readBlock, const BlockDecoder& decodeBlock) {
+    std::ifstream inFile(inputFile, std::ios::binary);
+    if (!inFile)
+        throw std::runtime_error("Cannot open input file");
 
     std::ofstream outFile(outputFile, std::ios::binary);
+    if (!outFile)
+        throw std::runtime_error("Cannot open output file");
+
+    const size_t usable = budget.bytes - MemoryBudget::kReserve;
+    std::vector<std::vector<unsigned char>> in(budget.threads), out(budget.threads);
+    std::vector<unsigned char> pending;
+    size_t pendingSize = 0;
+    bool havePending = false;
+
+    for (;;) {
+        size_t n = 0, inFlight = 0;
+
+        while (n < budget.threads) {
+            if (!havePending && !(havePending = readBlock(inFile, pending, pendingSize)))
+                break;
+
+            size_t cost = pending.size() + pendingSize;
+            if (cost > usable)
+                throw std::runtime_error("Compressed block exceeds memory budget");
+            if (n && inFlight + cost > usable)
+                break;
+
+            in[n].swap(pending);
+            out[n].clear();
+            out[n].reserve(pendingSize);
+            inFlight += cost;
+            havePending = false;
+            ++n;
+        }
+
+        if (!n)
+            break;
+
+        parallelFor(n, [&](size_t i) {
+            size_t pos = 0;
+            decodeBlock(in[i], pos, out[i]);
+        });
+
+        for (size_t i = 0; i < n; ++i)
+            outFile.write(reinterpret_cast<const char*>(out[i].data()), out[i].size());
+    }
+}
+
+void HuffmanCompression::compress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget) {
+    compressBlocks(inputFile, outputFile, budget, encodeBlock);
+}
+
+void HuffmanCompression::decompress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget) {
+    decompressBlocks(inputFile, outputFile, budget, readBlock, decodeBlock);
+}
+
+// Order-1 Huffman: the previous byte selects the code table. Contexts whose own table pays
+// for its header get one, the rest share table 0. Codes are canonical and length-limited so the
+// decoder resolves each symbol with one lookup into a 2^kMaxCodeLen table.
+class ContextHuffmanCompression {
+public:
+    static void compress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget);
+    static void decompress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget);
+    static std::vector<unsigned char> encode(const std::vector<unsigned char>& input);
+    static std::vector<unsigned char> decode(const std::vector<unsigned char>& input);
 
-    if (freqMap.empty()) {
-        outFile.close();
+private:
+    static constexpr int kMaxCodeLen = 11;
+    static constexpr uint32_t kMinContext = 64;
+    static constexpr size_t kBlockHeader = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint64_t);
+
+    struct Table {
+        uint8_t len[256];
+        uint16_t code[256];
+    };
+
+    static void codeLengths(const uint32_t* freq, uint8_t* len);
+    static void assignCodes(Table& table);
+    static void writeTable(std::vector<unsigned char>& out, const Table& table);
+    static void readTable(const unsigned char* in, size_t size, size_t& pos, Table& table);
+    static void encodeBlock(const unsigned char* data, size_t n, std::vector<unsigned char>& out);
+    static void decodeBlock(const std::vector<unsigned char>& in, size_t& pos, std::vector<unsigned char>& out);
+    static bool readBlock(std::ifstream& inFile, std::vector<unsigned char>& raw, size_t& decodedSize);
+};
+
+// Code lengths straight from the counts: sort the used symbols by frequency, build an optimal code in
+// place (Moffat-Katajainen), then cap it at kMaxCodeLen by moving codes down until the Kraft sum is 1 again.
+void ContextHuffmanCompression::codeLengths(const uint32_t* freq, uint8_t* len) {
+    std::pair<uint64_t, int> sym[256];
+    int n = 0;
+
+    std::memset(len, 0, 256);
+    for (int s = 0; s < 256; ++s)
+        if (freq[s])
+            sym[n++] = {freq[s], s};
+
+    if (n <= 1) {
+        if (n)
+            len[sym[0].second] = 1;
         return;
     }
 
-    HuffmanNode* root = buildHuffmanTree(freqMap);
-    std::map<unsigned char, std::string> huffmanCode;
-    buildCodes(root, "", huffmanCode);
+    std::sort(sym, sym + n);
+
+    uint64_t a[256];
+    for (int i = 0; i < n; ++i)
+        a[i] = sym[i].first;
+
+    // First pass: a[] becomes parent pointers of the internal nodes; second: their depths; third: leaf depths.
+    int root = 0, leaf = 2;
+    a[0] += a[1];
+    for (int next = 1; next < n - 1; ++next) {
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = next;
+        } else
+            a[next] = a[leaf++];
+
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = next;
+        } else
+            a[next] += a[leaf++];
+    }
 
-    writeFrequencyTable(outFile, freqMap);
-    writeCompressedFile(outFile, huffmanCode, inputFile);
-    outFile.close();
+    a[n - 2] = 0;
+    for (int next = n - 3; next >= 0; --next)
+        a[next] = a[a[next]] + 1;
 
-    delete root;
+    int avail = 1, used = 0, depth = 0, next = n - 1;
+    root = n - 2;
+    while (avail > 0) {
+        while (root >= 0 && a[root] == static_cast<uint64_t>(depth)) {
+            ++used;
+            --root;
+        }
+        while (avail > used) {
+            a[next--] = depth;
+            --avail;
+        }
+        avail = 2 * used;
+        ++depth;
+        used = 0;
+    }
+
+    // a[i] is now the length of sym[i], longest first. Count lengths, folding anything too long into kMaxCodeLen.
+    int count[kMaxCodeLen + 1] = {};
+    for (int i = 0; i < n; ++i)
+        count[std::min<uint64_t>(a[i], kMaxCodeLen)]++;
+
+    uint32_t kraft = 0;
+    for (int l = 1; l <= kMaxCodeLen; ++l)
+        kraft += static_cast<uint32_t>(count[l]) << (kMaxCodeLen - l);
+
+    while (kraft > (1u << kMaxCodeLen)) {
+        count[kMaxCodeLen]--;
+        for (int l = kMaxCodeLen - 1; l > 0; --l) {
+            if (count[l]) {
+                count[l]--;
+                count[l + 1] += 2;
+                break;
+            }
+        }
+        kraft--;
+    }
+
+    // The rarest symbols take the longest codes.
+    for (int l = kMaxCodeLen, i = 0; l > 0; --l)
+        for (int k = 0; k < count[l]; ++k)
+            len[sym[i++].second] = l;
 }
 
-void HuffmanCompression::decompress(const std::string& inputFile, const std::string& outputFile) {
-    std::ifstream inFile(inputFile, std::ios::binary);
-    if (!inFile)
-        throw std::runtime_error("Cannot open input file");
+void ContextHuffmanCompression::assignCodes(Table& table) {
+    int count[kMaxCodeLen + 1] = {};
+    int next[kMaxCodeLen + 2] = {};
 
-    std::ofstream outFile(outputFile, std::ios::binary);
+    for (int s = 0; s < 256; ++s)
+        count[table.len[s]]++;
+    count[0] = 0;
+
+    for (int l = 1; l <= kMaxCodeLen; ++l)
+        next[l + 1] = (next[l] + count[l]) << 1;
+
+    for (int s = 0; s < 256; ++s)
+        if (table.len[s])
+            table.code[s] = next[table.len[s]]++;
+}
+
+// Presence bitmap followed by one 4-bit length per present symbol.
+void ContextHuffmanCompression::writeTable(std::vector<unsigned char>& out, const Table& table) {
+    unsigned char bitmap[32] = {};
+    for (int s = 0; s < 256; ++s)
+        if (table.len[s])
+            bitmap[s >> 3] |= 1 << (s & 7);
+    out.insert(out.end(), bitmap, bitmap + 32);
+
+    BitWriter writer(out);
+    for (int s = 0; s < 256; ++s)
+        if (table.len[s])
+            writer.put(table.len[s], 4);
+    writer.flush();
+}
+
+void ContextHuffmanCompression::readTable(const unsigned char* in, size_t size, size_t& pos, Table& table) {
+    if (size - pos < 32)
+        throw std::runtime_error("Truncated context table");
+
+    const unsigned char* bitmap = in + pos;
+    int present = 0;
+    for (int i = 0; i < 32; ++i)
+        present += __builtin_popcount(bitmap[i]);
+    pos += 32;
+
+    size_t nibbleBytes = (present + 1) / 2;
+    if (size - pos < nibbleBytes)
+        throw std::runtime_error("Truncated context table");
+
+    BitReader reader(in + pos, nibbleBytes);
+    for (int s = 0; s < 256; ++s) {
+        table.len[s] = 0;
+        if (bitmap[s >> 3] & (1 << (s & 7))) {
+            reader.refill();
+            table.len[s] = reader.peek(4);
+            reader.skip(4);
+            if (!table.len[s] || table.len[s] > kMaxCodeLen)
+                throw std::runtime_error("Corrupt context table");
+        }
+    }
+    pos += nibbleBytes;
+
+    assignCodes(table);
+}
 
-    std::map<unsigned char, int> freqMap = readFrequencyTable(inFile);
-    if (freqMap.empty()) {
-        inFile.close();
-        outFile.close();
+void ContextHuffmanCompression::encodeBlock(const unsigned char* data, size_t n, std::vector<unsigned char>& out) {
+    if (!n)
         return;
+
+    std::vector<uint32_t> freq(256 * 256);
+    uint32_t total[256] = {};
+    unsigned prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        freq[prev * 256 + data[i]]++;
+        total[prev]++;
+        prev = data[i];
     }
 
-    std::string encodedData = readEncodedData(inFile);
-    inFile.close();
+    // A context gets its own table only if that saves more bits than its header costs against
+    // the block-wide order-0 table. Table 0 is the shared fallback, so at most 255 qualify.
+    std::vector<uint32_t> order0(256);
+    for (int c = 0; c < 256; ++c)
+        for (int s = 0; total[c] && s < 256; ++s)
+            order0[s] += freq[c * 256 + s];
+
+    uint8_t sharedLen[256], ownLen[256];
+    codeLengths(order0.data(), sharedLen);
+
+    std::vector<std::pair<int64_t, int>> gains;
+    for (int c = 0; c < 256; ++c) {
+        if (total[c] < kMinContext)
+            continue;
+
+        codeLengths(&freq[c * 256], ownLen);
+        int64_t gain = 0;
+        int present = 0;
+        for (int s = 0; s < 256; ++s) {
+            uint32_t f = freq[c * 256 + s];
+            gain += static_cast<int64_t>(f) * (sharedLen[s] - ownLen[s]);
+            present += ownLen[s] != 0;
+        }
+        gain -= (32 + (present + 1) / 2) * 8;
 
-    HuffmanNode* root = buildHuffmanTree(freqMap);
-    if (!root)
-        throw std::runtime_error("Failed to rebuild Huffman tree");
+        if (gain > 0)
+            gains.push_back({gain, c});
+    }
 
-    if (!root->left && !root->right)
-        for (size_t i = 0; i < encodedData.size(); ++i)
-            outFile.put(root->ch);
-    else {
-        HuffmanNode* current = root;
+    std::sort(gains.rbegin(), gains.rend());
+    if (gains.size() > 255)
+        gains.resize(255);
+
+    std::vector<int> dense;
+    for (const auto& g : gains)
+        dense.push_back(g.second);
+
+    unsigned char contextMap[256] = {};
+    for (size_t t = 0; t < dense.size(); ++t)
+        contextMap[dense[t]] = t + 1;
+
+    std::vector<uint32_t> tableFreq((dense.size() + 1) * 256);
+    for (int c = 0; c < 256; ++c)
+        for (int s = 0; total[c] && s < 256; ++s)
+            tableFreq[contextMap[c] * 256 + s] += freq[c * 256 + s];
+
+    std::vector<Table> tables(dense.size() + 1);
+    uint64_t bitLength = 0;
+    for (size_t t = 0; t < tables.size(); ++t) {
+        codeLengths(&tableFreq[t * 256], tables[t].len);
+        assignCodes(tables[t]);
+        for (int s = 0; s < 256; ++s)
+            bitLength += static_cast<uint64_t>(tableFreq[t * 256 + s]) * tables[t].len[s];
+    }
 
-        for (char bit : encodedData) {
-            current = (bit == '0') ? current->left : current->right;
+    std::vector<unsigned char> header;
+    header.push_back(dense.size());
+    header.insert(header.end(), dense.begin(), dense.end());
+    for (const Table& t : tables)
+        writeTable(header, t);
+
+    appendRaw(out, static_cast<uint64_t>(n));
+    appendRaw(out, static_cast<uint32_t>(header.size()));
+    appendRaw(out, bitLength);
+    out.insert(out.end(), header.begin(), header.end());
+    out.reserve(out.size() + (bitLength + 7) / 8);
+
+    BitWriter writer(out);
+    prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const Table& t = tables[contextMap[prev]];
+        writer.put(t.code[data[i]], t.len[data[i]]);
+        prev = data[i];
+    }
+    writer.flush();
+}
 
-            if (!current->left && !current->right) {
-                outFile.put(current->ch);
-                current = root;
-            }
+void ContextHuffmanCompression::decodeBlock(const std::vector<unsigned char>& in, size_t& pos, std::vector<unsigned char>& out) {
+    uint64_t symbols, bitLength;
+    uint32_t headerSize;
+    if (!readRaw(in, pos, symbols) || !readRaw(in, pos, headerSize) || !readRaw(in, pos, bitLength))
+        throw std::runtime_error("Truncated context Huffman block");
+    if (in.size() - pos < headerSize || (in.size() - pos - headerSize) < (bitLength + 7) / 8 || headerSize < 1)
+        throw std::runtime_error("Truncated context Huffman block");
+
+    const unsigned char* header = in.data() + pos;
+    size_t tableCount = header[0] + 1;
+    if (headerSize < tableCount)
+        throw std::runtime_error("Truncated context Huffman block");
+
+    unsigned char contextMap[256] = {};
+    for (size_t t = 1; t < tableCount; ++t)
+        contextMap[header[t]] = t;
+    size_t hpos = tableCount;
+
+    const size_t lutSize = 1 << kMaxCodeLen;
+    std::vector<uint16_t> lut(tableCount * lutSize);
+    for (size_t t = 0; t < tableCount; ++t) {
+        Table table;
+        readTable(header, headerSize, hpos, table);
+
+        uint16_t* entries = &lut[t * lutSize];
+        for (int s = 0; s < 256; ++s) {
+            int l = table.len[s];
+            if (!l)
+                continue;
+            size_t first = static_cast<size_t>(table.code[s]) << (kMaxCodeLen - l);
+            size_t last = first + (static_cast<size_t>(1) << (kMaxCodeLen - l));
+            if (last > lutSize)
+                throw std::runtime_error("Corrupt context table");
+            std::fill(entries + first, entries + last, static_cast<uint16_t>((s << 4) | l));
         }
     }
 
-    outFile.close();
-    delete root;
+    pos += headerSize;
+    const size_t payloadBytes = (bitLength + 7) / 8;
+    BitReader reader(in.data() + pos, payloadBytes);
+
+    size_t base = out.size();
+    out.resize(base + symbols);
+    unsigned char* dst = out.data() + base;
+    unsigned prev = 0;
+
+    for (uint64_t i = 0; i < symbols; ++i) {
+        if (reader.available() < kMaxCodeLen)
+            reader.refill();
+
+        uint16_t e = lut[contextMap[prev] * lutSize + reader.peek(kMaxCodeLen)];
+        if (!(e & 15))
+            throw std::runtime_error("Corrupt context Huffman stream");
+
+        reader.skip(e & 15);
+        dst[i] = prev = e >> 4;
+    }
+
+    if (reader.consumed() > bitLength)
+        throw std::runtime_error("Corrupt context Huffman stream");
+
+    pos += payloadBytes;
+}
+
+bool ContextHuffmanCompression::readBlock(std::ifstream& inFile, std::vector<unsigned char>& raw, size_t& decodedSize) {
+    raw.resize(kBlockHeader);
+    if (!inFile.read(reinterpret_cast<char*>(raw.data()), kBlockHeader))
+        return false;
+
+    uint64_t symbols = 0, bitLength = 0;
+    uint32_t headerSize = 0;
+    size_t pos = 0;
+    readRaw(raw, pos, symbols);
+    readRaw(raw, pos, headerSize);
+    readRaw(raw, pos, bitLength);
+
+    size_t rest = headerSize + (bitLength + 7) / 8;
+    raw.resize(kBlockHeader + rest);
+    if (!inFile.read(reinterpret_cast<char*>(raw.data() + kBlockHeader), rest))
+        throw std::runtime_error("Truncated context Huffman stream");
+
+    decodedSize = symbols;
+    return true;
+}
+
+std::vector<unsigned char> ContextHuffmanCompression::encode(const std::vector<unsigned char>& input) {
+    std::vector<unsigned char> out;
+    out.reserve(input.size() + input.size() / 8 + 2048);
+    encodeBlock(input.data(), input.size(), out);
+    return out;
+}
+
+std::vector<unsigned char> ContextHuffmanCompression::decode(const std::vector<unsigned char>& input) {
+    std::vector<unsigned char> out;
+    size_t pos = 0;
+
+    while (pos < input.size())
+        decodeBlock(input, pos, out);
+
+    return out;
+}
+
+void ContextHuffmanCompression::compress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget) {
+    compressBlocks(inputFile, outputFile, budget, encodeBlock);
+}
+
+void ContextHuffmanCompression::decompress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget) {
+    decompressBlocks(inputFile, outputFile, budget, readBlock, decodeBlock);
 }
 
 double calculateCompressionCoeff(const std::string& originalFile, const std::string& compressedFile) {
@@ -238,7 +969,66 @@ double calculateCompressionCoeff(const std::string& originalFile, const std::str
     return static_cast<double>(originalSize) / static_cast<double>(compressedSize);
 }
 
-double zlibCompress(const std::string& inputFile, const std::string& outputFile) {
+static z_stream makeStream() {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    zs.zalloc = zlibAlloc;
+    zs.zfree = zlibFree;
+    return zs;
+}
+
+std::vector<unsigned char> zlibEncode(const std::vector<unsigned char>& input) {
+    z_stream zs = makeStream();
+    if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw std::runtime_error("zlib compression failed");
+
+    std::vector<unsigned char> output(deflateBound(&zs, input.size()));
+    zs.next_in = const_cast<Bytef*>(input.data());
+    zs.avail_in = input.size();
+    zs.next_out = output.data();
+    zs.avail_out = output.size();
+
+    int result = deflate(&zs, Z_FINISH);
+    output.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    if (result != Z_STREAM_END)
+        throw std::runtime_error("zlib compression failed");
+
+    return output;
+}
+
+std::vector<unsigned char> zlibDecode(const std::vector<unsigned char>& input) {
+    z_stream zs = makeStream();
+    if (inflateInit(&zs) != Z_OK)
+        throw std::runtime_error("zlib decompression failed");
+
+    std::vector<unsigned char> output(std::max<size_t>(input.size() * 2, 4096));
+    zs.next_in = const_cast<Bytef*>(input.data());
+    zs.avail_in = input.size();
+
+    int result = Z_OK;
+    while (result == Z_OK) {
+        if (zs.total_out == output.size())
+            output.resize(output.size() + output.size() / 2);
+
+        zs.next_out = output.data() + zs.total_out;
+        zs.avail_out = output.size() - zs.total_out;
+        result = inflate(&zs, Z_NO_FLUSH);
+        if (result == Z_BUF_ERROR && zs.avail_in)
+            result = Z_OK;
+    }
+
+    output.resize(zs.total_out);
+    inflateEnd(&zs);
+
+    if (result != Z_STREAM_END)
+        throw std::runtime_error("zlib decompression failed");
+
+    return output;
+}
+
+double zlibCompress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget) {
     auto start = std::chrono::high_resolution_clock::now();
 
     std::ifstream inFile(inputFile, std::ios::binary);
@@ -249,20 +1039,37 @@ double zlibCompress(const std::string& inputFile, const std::string& outputFile)
     if (!outFile)
         throw std::runtime_error("Cannot open output file for zlib compression");
 
-    std::vector<char> input((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
-    std::vector<char> output(compressBound(input.size()));
-
-    uLongf compressedSize = output.size();
-    if (compress(reinterpret_cast<Bytef*>(output.data()), &compressedSize, reinterpret_cast<const Bytef*>(input.data()), input.size()) != Z_OK)
+    z_stream zs = makeStream();
+    if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK)
         throw std::runtime_error("zlib compression failed");
 
-    outFile.write(output.data(), compressedSize);
+    std::vector<unsigned char> input, output(budget.streamChunk());
+    int flush;
+
+    do {
+        readChunk(inFile, input, budget.streamChunk());
+        flush = inFile ? Z_NO_FLUSH : Z_FINISH;
+        zs.next_in = input.data();
+        zs.avail_in = input.size();
+
+        do {
+            zs.next_out = output.data();
+            zs.avail_out = output.size();
+            if (deflate(&zs, flush) == Z_STREAM_ERROR) {
+                deflateEnd(&zs);
+                throw std::runtime_error("zlib compression failed");
+            }
+            outFile.write(reinterpret_cast<const char*>(output.data()), output.size() - zs.avail_out);
+        } while (zs.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    deflateEnd(&zs);
 
     auto end = std::chrono::high_resolution_clock::now();
     return std::chrono::duration<double, std::milli>(end - start).count();
 }
 
-double zlibDecompress(const std::string& inputFile, const std::string& outputFile) {
+double zlibDecompress(const std::string& inputFile, const std::string& outputFile, const MemoryBudget& budget) {
     auto start = std::chrono::high_resolution_clock::now();
 
     std::ifstream inFile(inputFile, std::ios::binary);
@@ -273,34 +1080,44 @@ double zlibDecompress(const std::string& inputFile, const std::string& outputFil
     if (!outFile)
         throw std::runtime_error("Cannot open output file for zlib decompression");
 
-    std::vector<char> input((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
-    std::vector<char> output(input.size() * 4);
+    z_stream zs = makeStream();
+    if (inflateInit(&zs) != Z_OK)
+        throw std::runtime_error("zlib decompression failed");
 
-    uLongf decompressedSize = output.size();
-    int result = uncompress(reinterpret_cast<Bytef*>(output.data()), &decompressedSize, reinterpret_cast<const Bytef*>(input.data()), input.size());
+    std::vector<unsigned char> input, output(budget.streamChunk());
+    int result = Z_OK;
 
-    while (result == Z_BUF_ERROR) {
-        output.resize(output.size() * 2);
-        decompressedSize = output.size();
-        result = uncompress(reinterpret_cast<Bytef*>(output.data()), &decompressedSize, reinterpret_cast<const Bytef*>(input.data()), input.size());
-    }
+    while (result != Z_STREAM_END && readChunk(inFile, input, budget.streamChunk())) {
+        zs.next_in = input.data();
+        zs.avail_in = input.size();
 
-    if (result != Z_OK)
-        throw std::runtime_error("zlib decompression failed");
+        do {
+            zs.next_out = output.data();
+            zs.avail_out = output.size();
+            result = inflate(&zs, Z_NO_FLUSH);
+            if (result == Z_NEED_DICT || result == Z_DATA_ERROR || result == Z_MEM_ERROR || result == Z_STREAM_ERROR) {
+                inflateEnd(&zs);
+                throw std::runtime_error("zlib decompression failed");
+            }
+            outFile.write(reinterpret_cast<const char*>(output.data()), output.size() - zs.avail_out);
+        } while (zs.avail_out == 0 && result != Z_STREAM_END);
+    }
 
-    outFile.write(output.data(), decompressedSize);
+    inflateEnd(&zs);
+    if (result != Z_STREAM_END)
+        throw std::runtime_error("zlib decompression failed: truncated stream");
 
     auto end = std::chrono::high_resolution_clock::now();
     return std::chrono::duration<double, std::milli>(end - start).count();
 }
 
-void saveResultsToCSV(const std::string& filePath, const std::string& algorithm, const std::string& file, double compressionRatio, double encodeTime, double decodeTime) {
+void saveResultsToCSV(const std::string& filePath, const std::string& algorithm, const std::string& file, double compressionRatio, double encodeTime, double decodeTime, size_t peakBytes) {
     std::ofstream csvFile(filePath, std::ios::app);
     if (!csvFile)
         throw std::runtime_error("Cannot open CSV file");
 
     csvFile << algorithm << "," << file << "," << std::fixed << std::setprecision(6)
-            << compressionRatio << "," << encodeTime << "," << decodeTime << "\n";
+            << compressionRatio << "," << encodeTime << "," << decodeTime << "," << (peakBytes >> 10) << "\n";
 }
 
 static std::string baseName(const std::string& path) {
@@ -309,11 +1126,31 @@ static std::string baseName(const std::string& path) {
     return path.substr(pos + 1);
 }
 
-static void processFile(const std::string& inputFile, const std::string& csvFile, const std::string& outDir) {
+static uint64_t parseSize(const std::string& s) {
+    size_t pos;
+    double v = std::stod(s, &pos);
+    std::string suffix = s.substr(pos);
+    uint64_t mul = 1;
+
+    if (suffix == "K" || suffix == "k")
+        mul = 1ULL << 10;
+    else if (suffix == "M" || suffix == "m")
+        mul = 1ULL << 20;
+    else if (suffix == "G" || suffix == "g")
+        mul = 1ULL << 30;
+    else if (!suffix.empty())
+        throw std::runtime_error("Bad size suffix: " + s);
+
+    return static_cast<uint64_t>(v * mul);
+}
+
+static void processFile(const std::string& inputFile, const std::string& csvFile, const std::string& outDir, const MemoryBudget& budget) {
     std::string bn = baseName(inputFile);
 
     std::string huffEnc = outDir + "/huff.enc." + bn;
     std::string huffDec = outDir + "/huff.dec." + bn;
+    std::string ctxEnc = outDir + "/huff1.enc." + bn;
+    std::string ctxDec = outDir + "/huff1.dec." + bn;
     std::string zlibEnc = outDir + "/zlib.enc." + bn;
     std::string zlibDec = outDir + "/zlib.dec." + bn;
 
@@ -322,28 +1159,166 @@ static void processFile(const std::string& inputFile, const std::string& csvFile
     double huffmanDecodeTime = 0.0;
     double huffmanCompressionRatio = 0.0;
 
+    MemoryTracker::resetPeak();
     auto start = std::chrono::high_resolution_clock::now();
-    HuffmanCompression::compress(inputFile, huffEnc);
+    HuffmanCompression::compress(inputFile, huffEnc, budget);
     auto end = std::chrono::high_resolution_clock::now();
     huffmanEncodeTime = std::chrono::duration<double, std::milli>(end - start).count();
 
     start = std::chrono::high_resolution_clock::now();
-    HuffmanCompression::decompress(huffEnc, huffDec);
+    HuffmanCompression::decompress(huffEnc, huffDec, budget);
     end = std::chrono::high_resolution_clock::now();
     huffmanDecodeTime = std::chrono::duration<double, std::milli>(end - start).count();
 
     huffmanCompressionRatio = calculateCompressionCoeff(inputFile, huffEnc);
-    saveResultsToCSV(csvFile, "Huffman", inputFile, huffmanCompressionRatio, huffmanEncodeTime, huffmanDecodeTime);
+    saveResultsToCSV(csvFile, "Huffman", inputFile, huffmanCompressionRatio, huffmanEncodeTime, huffmanDecodeTime, MemoryTracker::peak());
+
+    // Order-1 Huffman
+    MemoryTracker::resetPeak();
+    start = std::chrono::high_resolution_clock::now();
+    ContextHuffmanCompression::compress(inputFile, ctxEnc, budget);
+    end = std::chrono::high_resolution_clock::now();
+    double ctxEncodeTime = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    ContextHuffmanCompression::decompress(ctxEnc, ctxDec, budget);
+    end = std::chrono::high_resolution_clock::now();
+    double ctxDecodeTime = std::chrono::duration<double, std::milli>(end - start).count();
+
+    saveResultsToCSV(csvFile, "Huffman-o1", inputFile, calculateCompressionCoeff(inputFile, ctxEnc), ctxEncodeTime, ctxDecodeTime, MemoryTracker::peak());
 
     // zlib
-    double zlibEncodeTime = zlibCompress(inputFile, zlibEnc);
-    double zlibDecodeTime = zlibDecompress(zlibEnc, zlibDec);
+    MemoryTracker::resetPeak();
+    double zlibEncodeTime = zlibCompress(inputFile, zlibEnc, budget);
+    double zlibDecodeTime = zlibDecompress(zlibEnc, zlibDec, budget);
     double zlibCompressionRatio = calculateCompressionCoeff(inputFile, zlibEnc);
-    saveResultsToCSV(csvFile, "zlib", inputFile, zlibCompressionRatio, zlibEncodeTime, zlibDecodeTime);
+    saveResultsToCSV(csvFile, "zlib", inputFile, zlibCompressionRatio, zlibEncodeTime, zlibDecodeTime, MemoryTracker::peak());
+}
+
+using Codec = std::function<std::vector<unsigned char>(const std::vector<unsigned char>&)>;
+
+struct BenchResult {
+    double compressionRatio;
+    double encodeMBps;
+    double decodeMBps;
+    size_t peakBytes;
+};
+
+// Streams the file through the codec in rounds of `threads` blocks so the working set stays within the budget.
+static BenchResult benchCodec(const std::string& inputFile, size_t fileSize, unsigned threads, const MemoryBudget& budget, const Codec& encode, const Codec& decode) {
+    const size_t blockSize = std::min(budget.blockSize, (fileSize + threads - 1) / threads);
+
+    std::ifstream inFile(inputFile, std::ios::binary);
+    if (!inFile)
+        throw std::runtime_error("Cannot open input file: " + inputFile);
+
+    std::vector<std::vector<unsigned char>> chunks(threads), encoded(threads), decoded(threads);
+    double encodeSec = 0.0, decodeSec = 0.0;
+    size_t compressedSize = 0;
+
+    MemoryTracker::resetPeak();
+
+    for (;;) {
+        size_t n = 0;
+        while (n < threads && readChunk(inFile, chunks[n], blockSize))
+            ++n;
+        if (!n)
+            break;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        parallelFor(n, [&](size_t i) { encoded[i] = encode(chunks[i]); });
+        auto end = std::chrono::high_resolution_clock::now();
+        encodeSec += std::chrono::duration<double>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        parallelFor(n, [&](size_t i) { decoded[i] = decode(encoded[i]); });
+        end = std::chrono::high_resolution_clock::now();
+        decodeSec += std::chrono::duration<double>(end - start).count();
+
+        for (size_t i = 0; i < n; ++i) {
+            if (decoded[i] != chunks[i])
+                throw std::runtime_error("Round-trip mismatch in benchmark");
+            compressedSize += encoded[i].size();
+            std::vector<unsigned char>().swap(encoded[i]);
+            std::vector<unsigned char>().swap(decoded[i]);
+        }
+    }
+
+    const double mb = static_cast<double>(fileSize) / (1024.0 * 1024.0);
+    return {
+        compressedSize ? static_cast<double>(fileSize) / compressedSize : 0.0,
+        encodeSec > 0 ? mb / encodeSec : 0.0,
+        decodeSec > 0 ? mb / decodeSec : 0.0,
+        MemoryTracker::peak(),
+    };
+}
+
+static void runBenchmark(const std::string& inputFile, unsigned threads, const std::string& csvFile, size_t budgetBytes) {
+    if (threads == 0)
+        throw std::runtime_error("Thread count must be positive");
+
+    struct stat st;
+    if (stat(inputFile.c_str(), &st) != 0 || st.st_size == 0)
+        throw std::runtime_error("Benchmark input is missing or empty: " + inputFile);
+
+    MemoryBudget budget = MemoryBudget::plan(budgetBytes, threads);
+    if (budget.threads < threads)
+        throw std::runtime_error("Memory budget cannot fit " + std::to_string(threads) + " threads");
+
+    bool fresh = stat(csvFile.c_str(), &st) != 0;
+    std::ofstream csv(csvFile, std::ios::app);
+    if (!csv)
+        throw std::runtime_error("Cannot open CSV file");
+    if (fresh)
+        csv << "algorithm,corpus,size_bytes,threads,compression_ratio,encode_mb_s,decode_mb_s,peak_heap_kb\n";
+
+    stat(inputFile.c_str(), &st);
+    const size_t fileSize = st.st_size;
+
+    const std::pair<std::string, std::pair<Codec, Codec>> codecs[] = {
+        {"Huffman", {HuffmanCompression::encode, HuffmanCompression::decode}},
+        {"Huffman-o1", {ContextHuffmanCompression::encode, ContextHuffmanCompression::decode}},
+        {"zlib", {zlibEncode, zlibDecode}},
+    };
+
+    for (const auto& c : codecs) {
+        BenchResult r = benchCodec(inputFile, fileSize, threads, budget, c.second.first, c.second.second);
+        csv << c.first << "," << baseName(inputFile) << "," << fileSize << "," << threads << ","
+            << std::fixed << std::setprecision(6)
+            << r.compressionRatio << "," << r.encodeMBps << "," << r.decodeMBps << "," << (r.peakBytes >> 10) << "\n";
+        std::cout << "[Bench]: " << c.first << " " << inputFile << " threads=" << threads
+                  << " ratio=" << r.compressionRatio << " enc=" << r.encodeMBps << "MB/s dec=" << r.decodeMBps << "MB/s"
+                  << " peak=" << (r.peakBytes >> 10) << "KB" << std::endl;
+    }
 }
 
 int main(int argc, char** argv) {
     try {
+        size_t budgetBytes = 256 << 20;
+        std::vector<std::string> args(argv + 1, argv + argc);
+
+        if (args.size() >= 2 && args[0] == "--budget") {
+            budgetBytes = parseSize(args[1]);
+            args.erase(args.begin(), args.begin() + 2);
+        }
+
+        MemoryTracker::setLimit(budgetBytes);
+
+        if (!args.empty() && args[0] == "--bench") {
+            if (args.size() < 3) {
+                std::cerr << "Usage: " << argv[0] << " [--budget SIZE] --bench <file> <threads> [csv]\n";
+                return 2;
+            }
+            runBenchmark(args[1], std::stoul(args[2]), args.size() > 3 ? args[3] : "out/bench.csv", budgetBytes);
+            std::cout << "[Memory]: peak RSS " << (MemoryTracker::peakRSS() >> 10) << " KB" << std::endl;
+            return 0;
+        }
+
+        const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        const MemoryBudget budget = MemoryBudget::plan(budgetBytes, hw);
+        std::cout << "[Budget]: " << (budget.bytes >> 20) << " MB, " << budget.threads << " threads, "
+                  << (budget.blockSize >> 10) << " KB blocks" << std::endl;
+
         const std::string outDir = "out";
         struct stat st_out;
         if (stat(outDir.c_str(), &st_out) != 0) {
@@ -359,7 +1334,7 @@ int main(int argc, char** argv) {
         std::ofstream header(csvFile, std::ios::trunc);
         if (!header)
             throw std::runtime_error("Cannot create CSV file");
-        header << "algorithm,file,compression_ratio,encode_time_ms,decode_time_ms\n";
+        header << "algorithm,file,compression_ratio,encode_time_ms,decode_time_ms,peak_heap_kb\n";
         header.close();
 
         const std::string dataDir = "data";
@@ -377,17 +1352,20 @@ int main(int argc, char** argv) {
                 struct stat st;
                 if (stat(fullpath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
                     std::cout << "[Processing]: " << fullpath << std::endl;
-                    processFile(fullpath, csvFile, outDir);
+                    processFile(fullpath, csvFile, outDir, budget);
                 }
             }
         }
         closedir(dir);
 
-        std::cout << "[OK]: saved to " << csvFile << std::endl;
+        std::cout << "[OK]: saved to " << csvFile << ", peak RSS " << (MemoryTracker::peakRSS() >> 10) << " KB" << std::endl;
+    } catch (const std::bad_alloc&) {
+        std::cerr << "Error: memory budget exceeded\n";
+        return 1;
     } catch (const std::exception& ex) {
         std::cerr << "Error: " << ex.what() << '\n';
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}